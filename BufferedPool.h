@@ -0,0 +1,282 @@
+#pragma once
+#include "EntityRegistry.h"
+#include <atomic>
+
+namespace sde
+{
+
+	/* BufferedPool - Opt-in triple-buffered component storage for running the
+	renderer in parallel with the simulation. The simulation thread writes the back
+	buffer; EntityRegistry::swapBuffers publishes it without copying, and the render
+	thread picks up the newest published buffer with acquireFrontBuffers and reads
+	it through front() while the next tick is being written. Neither side waits for
+	the other.
+
+	After a publish the writer continues on an older buffer, which is brought up to
+	date by copying only the chunks written since that buffer was last current.
+	Adding or removing entities changes the layout, so buffers catch up with a full
+	copy after such a tick. Writes must go through write() or emplace() to be seen.
+
+	One writer thread and one reader thread. Attach with
+	registry.poolOf<BufferedPool<T>>() before the reader starts, and reserve and
+	warm it up before then too, since that touches all three buffers.
+	*/
+
+	template<typename T>
+	class BufferedPool : public BufferedPoolBase
+	{
+	public:
+		static constexpr std::size_t chunkBits = 6;
+		static constexpr std::size_t chunkSize = std::size_t{ 1 } << chunkBits;
+		// Publishes remembered for chunked catch-up; older buffers are copied in full
+		static constexpr std::size_t historyLength = 4;
+
+		// Read-only view of a published buffer
+		struct View
+		{
+			const T *data;
+			const EntityId *entities;
+			std::size_t size;
+			std::uint64_t frame;
+
+			// f(EntityId, const T &)
+			template<typename F>
+			void each(F f) const
+			{
+				for (std::size_t i = 0; i < size; ++i)
+					f(entities[i], data[i]);
+			}
+		};
+
+		explicit BufferedPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			BufferedPoolBase{ resource },
+			m_buffers{ Buffer{ resource }, Buffer{ resource }, Buffer{ resource } },
+			m_dirty{ resource }, m_history{ History{ resource }, History{ resource }, History{ resource }, History{ resource } },
+			m_published{ 0 }, m_structural{ false }, m_middle{ 1 }, m_back{ 0 }, m_front{ 2 }
+		{}
+
+		// Writer side
+
+		T &emplace(EntityId id, const T &value)
+		{
+			auto &back = m_buffers[m_back];
+			auto slot = findSlot(id);
+			if (slot != SparseIndex::npos)
+			{
+				markDirty(slot);
+				back.data[slot] = value;
+				return back.data[slot];
+			}
+			addEntity(id);
+			back.data.push_back(value);
+			m_structural = true;
+			return back.data.back();
+		}
+		void remove(EntityId id) override
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			auto last = eraseSlot(slot);
+			eraseFromColumns(slot, last, m_buffers[m_back].data);
+			m_structural = true;
+		}
+		// Back buffer component for modification, or nullptr
+		T *write(EntityId id)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return nullptr;
+			markDirty(slot);
+			return &m_buffers[m_back].data[slot];
+		}
+		// Back buffer component as written so far this tick, or nullptr
+		const T *read(EntityId id) const
+		{
+			auto slot = findSlot(id);
+			return slot == SparseIndex::npos ? nullptr : &m_buffers[m_back].data[slot];
+		}
+
+		void publish(std::uint64_t frame) override
+		{
+			auto &back = m_buffers[m_back];
+			if (m_structural) back.entities.assign(std::begin(m_entities), std::end(m_entities));
+			back.frame = frame;
+			back.sequence = ++m_published;
+			auto &h = m_history[m_published % historyLength];
+			h.sequence = m_published;
+			h.full = m_structural;
+			h.chunks.swap(m_dirty);
+			m_dirty.assign(h.chunks.size(), 0);
+			m_structural = false;
+
+			auto published = m_back;
+			m_back = m_middle.exchange(published | freshBit) & indexMask;
+			catchUp(m_buffers[m_back], m_buffers[published]);
+		}
+
+		void reserve(std::size_t count, std::size_t indexBound) override
+		{
+			PoolBase::reserve(count, indexBound);
+			auto words = ((count + chunkSize - 1) / chunkSize + 63) / 64;
+			for (auto &b : m_buffers)
+			{
+				b.data.reserve(count);
+				b.entities.reserve(count);
+			}
+			// Dirty bits swap places with the history at every publish
+			m_dirty.reserve(words);
+			for (auto &h : m_history)
+				h.chunks.reserve(words);
+		}
+		void prefault() override
+		{
+			PoolBase::prefault();
+			for (auto &b : m_buffers)
+			{
+				touchCapacity(b.data);
+				touchCapacity(b.entities);
+			}
+			touchCapacity(m_dirty);
+			for (auto &h : m_history)
+				touchCapacity(h.chunks);
+		}
+		void memoryRanges(std::vector<MemoryRange> &out) const override
+		{
+			PoolBase::memoryRanges(out);
+			for (auto &b : m_buffers)
+			{
+				addMemoryRange(out, b.data);
+				addMemoryRange(out, b.entities);
+			}
+			addMemoryRange(out, m_dirty);
+			for (auto &h : m_history)
+				addMemoryRange(out, h.chunks);
+		}
+
+		// Copies the writer's state; the copy starts out with no reader
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override
+		{
+			auto pp = makeResourcePtr<BufferedPool>(resource);
+			pp->copyBase(*this);
+			pp->m_buffers[pp->m_back].data = m_buffers[m_back].data;
+			pp->m_structural = true;
+			return pp;
+		}
+
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		void absorb(PoolBase &other) override
+		{
+			auto &src = static_cast<BufferedPool &>(other);
+			auto &from = src.m_buffers[src.m_back].data;
+			auto &back = m_buffers[m_back].data;
+			appendEntities(src);
+			back.insert(std::end(back), std::begin(from), std::end(from));
+			m_structural = true;
+		}
+
+		// Reader side
+
+		// Buffer picked up by the last acquireFront (or registry acquireFrontBuffers);
+		// stays valid and unchanged until the next acquire
+		View front() const
+		{
+			auto &f = m_buffers[m_front];
+			return View{ f.data.data(), f.entities.data(), f.data.size(), f.frame };
+		}
+		std::uint64_t acquireFront() override
+		{
+			if (m_middle.load() & freshBit) m_front = m_middle.exchange(m_front) & indexMask;
+			return m_buffers[m_front].frame;
+		}
+
+	private:
+		static constexpr std::uint8_t indexMask = 3;
+		static constexpr std::uint8_t freshBit = 4;
+
+		struct Buffer
+		{
+			explicit Buffer(std::pmr::memory_resource *resource) :
+				data{ resource }, entities{ resource }, frame{ 0 }, sequence{ 0 }
+			{}
+			std::pmr::vector<T> data;
+			std::pmr::vector<EntityId> entities;
+			std::uint64_t frame;
+			// Number of publishes this buffer reflects
+			std::uint64_t sequence;
+		};
+		struct History
+		{
+			explicit History(std::pmr::memory_resource *resource) :
+				sequence{ 0 }, full{ true }, chunks{ resource }
+			{}
+			std::uint64_t sequence;
+			bool full;
+			// One bit per chunk written in that tick
+			std::pmr::vector<std::uint64_t> chunks;
+		};
+
+		inline void markDirty(std::uint32_t slot)
+		{
+			auto chunk = slot >> chunkBits;
+			if ((chunk >> 6) >= m_dirty.size()) m_dirty.resize((chunk >> 6) + 1, 0);
+			m_dirty[chunk >> 6] |= std::uint64_t{ 1 } << (chunk & 63);
+		}
+		// Brings dst up to src, which is newer, copying only what changed in between
+		void catchUp(Buffer &dst, const Buffer &src)
+		{
+			bool full = src.sequence - dst.sequence > historyLength;
+			for (auto seq = dst.sequence + 1; !full && seq <= src.sequence; ++seq)
+			{
+				auto &h = m_history[seq % historyLength];
+				full = h.sequence != seq || h.full;
+			}
+			if (full)
+			{
+				dst.data.assign(std::begin(src.data), std::end(src.data));
+				dst.entities.assign(std::begin(src.entities), std::end(src.entities));
+			}
+			else
+			{
+				for (auto seq = dst.sequence + 1; seq <= src.sequence; ++seq)
+				{
+					auto &chunks = m_history[seq % historyLength].chunks;
+					for (std::size_t w = 0; w < chunks.size(); ++w)
+					{
+						for (auto bits = chunks[w]; bits; bits &= bits - 1)
+						{
+							auto chunk = w * 64 + lowestBit(bits);
+							auto begin = chunk * chunkSize;
+							auto end = std::min(begin + chunkSize, src.data.size());
+							if (begin < end) std::copy(src.data.begin() + begin, src.data.begin() + end, dst.data.begin() + begin);
+						}
+					}
+				}
+			}
+			dst.frame = src.frame;
+			dst.sequence = src.sequence;
+		}
+		static std::size_t lowestBit(std::uint64_t bits)
+		{
+			std::size_t n = 0;
+			while (!(bits & 1))
+			{
+				bits >>= 1;
+				++n;
+			}
+			return n;
+		}
+
+		Buffer m_buffers[3];
+		std::pmr::vector<std::uint64_t> m_dirty;
+		History m_history[historyLength];
+		std::uint64_t m_published;
+		bool m_structural;
+		// Index of the published buffer between the two threads, plus freshBit
+		std::atomic<std::uint8_t> m_middle;
+		// Owned by the writer and the reader respectively
+		std::uint8_t m_back;
+		std::uint8_t m_front;
+	};
+}
@@ -0,0 +1,306 @@
+#include "Compress.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <thread>
+
+namespace sde
+{
+	namespace
+	{
+		constexpr std::uint32_t hashBits = 14;
+		constexpr std::size_t minMatch = 4;
+		// The last match must start this far from the end, and the last literals be
+		// at least lastLiterals long
+		constexpr std::size_t matchLimit = 12;
+		constexpr std::size_t lastLiterals = 5;
+		constexpr std::size_t maxOffset = 65535;
+
+		inline std::uint32_t read32(const unsigned char *p)
+		{
+			std::uint32_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		inline std::uint32_t hash32(std::uint32_t v)
+		{
+			return (v * 2654435761u) >> (32 - hashBits);
+		}
+
+		inline unsigned char *writeLength(unsigned char *op, std::size_t n)
+		{
+			for (; n >= 255; n -= 255)
+				*op++ = 255;
+			*op++ = static_cast<unsigned char>(n);
+			return op;
+		}
+
+		inline bool readLength(const unsigned char *&ip, const unsigned char *iend, std::size_t &n)
+		{
+			unsigned char b;
+			do
+			{
+				if (ip == iend) return false;
+				b = *ip++;
+				n += b;
+			} while (b == 255);
+			return true;
+		}
+
+		inline unsigned char *writeLiterals(unsigned char *op, unsigned char *token, const unsigned char *src, std::size_t n)
+		{
+			*token = static_cast<unsigned char>(std::min<std::size_t>(n, 15) << 4);
+			if (n >= 15) op = writeLength(op, n - 15);
+			if (n) std::memcpy(op, src, n);
+			return op + n;
+		}
+
+		template<typename Word>
+		void deltaLanes(unsigned char *data, std::size_t count, std::size_t stride, bool encode)
+		{
+			auto lanes = stride / sizeof(Word);
+			auto lane = [data, stride](std::size_t record, std::size_t i)
+			{
+				return data + record * stride + i * sizeof(Word);
+			};
+			for (std::size_t n = 1; n < count; ++n)
+			{
+				// Encoding runs backwards so every record is diffed against the original
+				auto record = encode ? count - n : n;
+				for (std::size_t i = 0; i < lanes; ++i)
+				{
+					Word cur, prev;
+					std::memcpy(&cur, lane(record, i), sizeof(Word));
+					std::memcpy(&prev, lane(record - 1, i), sizeof(Word));
+					cur = encode ? static_cast<Word>(cur - prev) : static_cast<Word>(cur + prev);
+					std::memcpy(lane(record, i), &cur, sizeof(Word));
+				}
+			}
+		}
+
+		inline void put32(unsigned char *p, std::uint32_t v)
+		{
+			std::memcpy(p, &v, sizeof(v));
+		}
+
+		// Runs f(i) for i in [0, count) on up to hardware_concurrency threads
+		template<typename F>
+		void forEachIndex(std::size_t count, bool parallel, F f)
+		{
+			std::atomic<std::size_t> next{ 0 };
+			auto worker = [&]
+			{
+				for (std::size_t i = next++; i < count; i = next++)
+					f(i);
+			};
+			std::size_t workerCount = std::min<std::size_t>(count, std::thread::hardware_concurrency());
+			std::vector<std::future<void>> workers;
+			if (parallel)
+			{
+				for (std::size_t i = 1; i < workerCount; ++i)
+					workers.push_back(std::async(std::launch::async, worker));
+			}
+			worker();
+			for (auto &w : workers)
+				w.get();
+		}
+	}
+
+	std::size_t compress(const void *src, std::size_t size, void *dst)
+	{
+		auto in = static_cast<const unsigned char *>(src);
+		auto out = static_cast<unsigned char *>(dst);
+		auto op = out;
+		std::size_t anchor = 0;
+		if (size > matchLimit)
+		{
+			std::unique_ptr<std::uint32_t[]> table{ new std::uint32_t[std::size_t{ 1 } << hashBits]() };
+			auto limit = size - matchLimit;
+			auto matchEnd = size - lastLiterals;
+			std::size_t ip = 1;
+			std::size_t misses = 0;
+			while (ip < limit)
+			{
+				auto seq = read32(in + ip);
+				auto &slot = table[hash32(seq)];
+				std::size_t candidate = slot;
+				slot = static_cast<std::uint32_t>(ip);
+				if (candidate >= ip || ip - candidate > maxOffset || read32(in + candidate) != seq)
+				{
+					// Skip ahead faster through data that does not compress
+					ip += 1 + (misses++ >> 6);
+					continue;
+				}
+				misses = 0;
+				while (ip > anchor && candidate > 0 && in[ip - 1] == in[candidate - 1])
+				{
+					--ip;
+					--candidate;
+				}
+				auto length = minMatch;
+				// Compare 8 bytes at a time, then find the mismatch within the last word
+				while (ip + length + 8 <= matchEnd)
+				{
+					std::uint64_t a, b;
+					std::memcpy(&a, in + candidate + length, sizeof(a));
+					std::memcpy(&b, in + ip + length, sizeof(b));
+					if (a != b) break;
+					length += 8;
+				}
+				while (ip + length < matchEnd && in[candidate + length] == in[ip + length])
+					++length;
+
+				auto token = op++;
+				op = writeLiterals(op, token, in + anchor, ip - anchor);
+				auto offset = static_cast<std::uint16_t>(ip - candidate);
+				*op++ = static_cast<unsigned char>(offset);
+				*op++ = static_cast<unsigned char>(offset >> 8);
+				auto extra = length - minMatch;
+				*token |= static_cast<unsigned char>(std::min<std::size_t>(extra, 15));
+				if (extra >= 15) op = writeLength(op, extra - 15);
+
+				ip += length;
+				anchor = ip;
+				if (ip < limit) table[hash32(read32(in + ip - 2))] = static_cast<std::uint32_t>(ip - 2);
+			}
+		}
+		auto token = op++;
+		op = writeLiterals(op, token, in + anchor, size - anchor);
+		return op - out;
+	}
+
+	bool decompress(const void *src, std::size_t size, void *dst, std::size_t rawSize)
+	{
+		auto ip = static_cast<const unsigned char *>(src);
+		auto iend = ip + size;
+		auto out = static_cast<unsigned char *>(dst);
+		auto op = out;
+		auto oend = out + rawSize;
+		while (ip < iend)
+		{
+			auto token = *ip++;
+			std::size_t literals = token >> 4;
+			if (literals == 15 && !readLength(ip, iend, literals)) return false;
+			if (literals > static_cast<std::size_t>(iend - ip) || literals > static_cast<std::size_t>(oend - op)) return false;
+			if (literals) std::memcpy(op, ip, literals);
+			op += literals;
+			ip += literals;
+			// The last sequence has literals only
+			if (ip == iend) break;
+
+			if (iend - ip < 2) return false;
+			std::size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > static_cast<std::size_t>(op - out)) return false;
+			std::size_t length = token & 15;
+			if (length == 15 && !readLength(ip, iend, length)) return false;
+			length += minMatch;
+			if (length > static_cast<std::size_t>(oend - op)) return false;
+			auto match = op - offset;
+			// An overlapping match repeats the last offset bytes; copying offset bytes at a
+			// time never reads what the same copy writes
+			for (std::size_t i = 0; i < length; i += offset)
+				std::memcpy(op + i, match + i, std::min(offset, length - i));
+			op += length;
+		}
+		return op == oend;
+	}
+
+	void deltaEncode(void *data, std::size_t count, std::size_t stride)
+	{
+		if (stride % 4 == 0) deltaLanes<std::uint32_t>(static_cast<unsigned char *>(data), count, stride, true);
+		else deltaLanes<std::uint8_t>(static_cast<unsigned char *>(data), count, stride, true);
+	}
+
+	void deltaDecode(void *data, std::size_t count, std::size_t stride)
+	{
+		if (stride % 4 == 0) deltaLanes<std::uint32_t>(static_cast<unsigned char *>(data), count, stride, false);
+		else deltaLanes<std::uint8_t>(static_cast<unsigned char *>(data), count, stride, false);
+	}
+
+	void encodeFrame(const void *data, std::size_t size, BlockEncoding encoding, std::size_t stride, std::vector<unsigned char> &out)
+	{
+		if (encoding == BlockEncoding::deltaLz && (stride == 0 || size % stride)) encoding = BlockEncoding::lz;
+		auto base = out.size();
+		out.resize(base + frameHeaderSize + (encoding == BlockEncoding::raw ? size : compressBound(size)));
+		auto payload = out.data() + base + frameHeaderSize;
+		std::size_t stored = size;
+		if (size == 0) encoding = BlockEncoding::raw;
+		if (encoding == BlockEncoding::raw)
+		{
+			if (size) std::memcpy(payload, data, size);
+		}
+		else if (encoding == BlockEncoding::lz) stored = compress(data, size, payload);
+		else
+		{
+			std::vector<unsigned char> deltas(static_cast<const unsigned char *>(data), static_cast<const unsigned char *>(data) + size);
+			deltaEncode(deltas.data(), size / stride, stride);
+			stored = compress(deltas.data(), size, payload);
+		}
+		if (encoding != BlockEncoding::raw && stored >= size)
+		{
+			encoding = BlockEncoding::raw;
+			std::memcpy(payload, data, size);
+			stored = size;
+		}
+		auto header = out.data() + base;
+		header[0] = static_cast<unsigned char>(encoding);
+		put32(header + 1, static_cast<std::uint32_t>(stride));
+		put32(header + 5, static_cast<std::uint32_t>(size));
+		put32(header + 9, static_cast<std::uint32_t>(stored));
+		out.resize(base + frameHeaderSize + stored);
+	}
+
+	bool readFrameHeader(const unsigned char *p, std::size_t available, FrameHeader &header)
+	{
+		if (available < frameHeaderSize || p[0] > static_cast<unsigned char>(BlockEncoding::deltaLz)) return false;
+		header.encoding = static_cast<BlockEncoding>(p[0]);
+		header.stride = read32(p + 1);
+		header.rawSize = read32(p + 5);
+		header.storedSize = read32(p + 9);
+		if (header.encoding == BlockEncoding::raw && header.storedSize != header.rawSize) return false;
+		if (header.encoding == BlockEncoding::deltaLz && (header.stride == 0 || header.rawSize % header.stride)) return false;
+		return header.storedSize <= available - frameHeaderSize;
+	}
+
+	bool decodeFrame(const unsigned char *frame, unsigned char *out)
+	{
+		FrameHeader header{};
+		if (!readFrameHeader(frame, frameHeaderSize + read32(frame + 9), header)) return false;
+		auto payload = frame + frameHeaderSize;
+		if (header.encoding == BlockEncoding::raw)
+		{
+			if (header.rawSize) std::memcpy(out, payload, header.rawSize);
+			return true;
+		}
+		if (!decompress(payload, header.storedSize, out, header.rawSize)) return false;
+		if (header.encoding == BlockEncoding::deltaLz) deltaDecode(out, header.rawSize / header.stride, header.stride);
+		return true;
+	}
+
+	std::vector<std::vector<unsigned char>> encodeFrames(const void *data, std::size_t size, std::size_t chunk, BlockEncoding encoding,
+		std::size_t stride, bool parallel)
+	{
+		auto bytes = static_cast<const unsigned char *>(data);
+		std::vector<std::vector<unsigned char>> frames((size + chunk - 1) / chunk);
+		forEachIndex(frames.size(), parallel, [&](std::size_t i)
+		{
+			auto first = i * chunk;
+			encodeFrame(bytes + first, std::min(chunk, size - first), encoding, stride, frames[i]);
+		});
+		return frames;
+	}
+
+	bool decodeFrames(const std::vector<FrameJob> &jobs, bool parallel)
+	{
+		std::atomic<bool> ok{ true };
+		forEachIndex(jobs.size(), parallel, [&](std::size_t i)
+		{
+			if (!decodeFrame(jobs[i].frame, jobs[i].out)) ok = false;
+		});
+		return ok;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sde
+{
+
+	/* Block compression - Self-contained LZ77 codec in the style of LZ4: a greedy
+	matcher over a hash table of 4-byte sequences, byte-aligned tokens and no
+	entropy coding, so both directions run at close to memory speed. Compressed
+	bytes carry no sizes or checksums; frames below add the sizes.
+	*/
+
+	// Largest output compress can produce for size input bytes
+	inline std::size_t compressBound(std::size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+	// Compresses size bytes into dst, which holds compressBound(size); returns the
+	// compressed length
+	std::size_t compress(const void *src, std::size_t size, void *dst);
+	// Decompresses exactly rawSize bytes into dst; returns false on malformed input
+	bool decompress(const void *src, std::size_t size, void *dst, std::size_t rawSize);
+
+	/* Delta encoding - Replaces each record of a column with its difference from the
+	previous one, lane by lane, so slowly changing numeric fields and ascending ids
+	turn into runs of small values that compress well. Lanes are 32-bit words when
+	stride is a multiple of 4 and bytes otherwise; arithmetic wraps, so any bit
+	pattern round-trips.
+	*/
+
+	void deltaEncode(void *data, std::size_t count, std::size_t stride);
+	void deltaDecode(void *data, std::size_t count, std::size_t stride);
+
+	/* Frames - A compressed block with its header: encoding, record stride, raw and
+	stored size. encodeFrame falls back to storing raw bytes when compression does
+	not pay off. Frames encode and decode independently, so encodeFrames and
+	decodeFrames spread a batch over worker threads.
+	*/
+
+	enum class BlockEncoding : std::uint8_t
+	{
+		raw,
+		lz,
+		// Delta encoding by stride, then lz
+		deltaLz
+	};
+
+	struct FrameHeader
+	{
+		BlockEncoding encoding;
+		std::uint32_t stride;
+		std::uint32_t rawSize;
+		std::uint32_t storedSize;
+	};
+
+	constexpr std::size_t frameHeaderSize = 13;
+
+	// Appends the frame for size bytes of data to out
+	void encodeFrame(const void *data, std::size_t size, BlockEncoding encoding, std::size_t stride, std::vector<unsigned char> &out);
+	// Parses the header at p; false if it is malformed or the frame runs past available
+	bool readFrameHeader(const unsigned char *p, std::size_t available, FrameHeader &header);
+	// Decodes a frame into out, which holds rawSize bytes; false if the header is
+	// malformed or the payload does not decode
+	bool decodeFrame(const unsigned char *frame, unsigned char *out);
+
+	// Splits data into frames of at most chunk bytes (a multiple of stride for
+	// deltaLz) and encodes them, in parallel when there are several
+	std::vector<std::vector<unsigned char>> encodeFrames(const void *data, std::size_t size, std::size_t chunk, BlockEncoding encoding,
+		std::size_t stride, bool parallel = true);
+
+	struct FrameJob
+	{
+		const unsigned char *frame;
+		unsigned char *out;
+	};
+
+	// Decodes every job, in parallel when there are several; false if any fails
+	bool decodeFrames(const std::vector<FrameJob> &jobs, bool parallel = true);
+}
@@ -3,37 +3,27 @@
 
 namespace sde
 {
-	void Entity::setAllComponentsActive(bool b)
-	{
-		for (auto &up : m_component)
-			up->setActive(b);
-	}
-
-	void Entity::initializeAllComponents()
-	{
-		for (auto &up : m_component)
-			up->initialize();
-	}
+	template class BasicEntity<ComponentBase>;
 
-	void Entity::addTag(const std::string &tag)
+	void VectorTags::addTag(const std::string &tag)
 	{
 		m_tag.emplace_back(tag);
 	}
 
-	bool Entity::hasTag(const std::string &tag) const
+	bool VectorTags::hasTag(const std::string &tag) const
 	{
 		auto it = std::find(std::begin(m_tag), std::end(m_tag), tag);
 		if (it != std::end(m_tag)) return true;
 		return false;
 	}
 
-	void Entity::removeTag(const std::string &tag)
+	void VectorTags::removeTag(const std::string &tag)
 	{
 		auto it = std::find(std::begin(m_tag), std::end(m_tag), tag);
 		if (it != std::end(m_tag)) m_tag.erase(it);
 	}
 
-	const std::vector<std::string> &Entity::getTags()
+	const std::vector<std::string> &VectorTags::getTags()
 	{
 		return m_tag;
 	}
@@ -0,0 +1,654 @@
+#include "EntityRegistry.h"
+#include "Partition.h"
+#include "PageFile.h"
+#include <list>
+#include <atomic>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace sde
+{
+	std::size_t nextComponentTypeId()
+	{
+		static std::atomic<std::size_t> next{ 0 };
+		return next++;
+	}
+
+	SparseIndex::~SparseIndex()
+	{
+		for (std::size_t page = 0; page < m_pages.size(); ++page)
+			freePage(page);
+	}
+
+	void SparseIndex::freePage(std::size_t page)
+	{
+		if (!m_pages[page]) return;
+		m_pages.get_allocator().resource()->deallocate(m_pages[page], pageSize * sizeof(std::uint32_t), alignof(std::uint32_t));
+		m_pages[page] = nullptr;
+	}
+
+	void SparseIndex::set(std::uint32_t index, std::uint32_t slot)
+	{
+		auto page = index >> pageBits;
+		if (page >= m_pages.size())
+		{
+			m_pages.resize(page + 1, nullptr);
+			m_counts.resize(page + 1, 0);
+		}
+		if (!m_pages[page])
+		{
+			auto mem = m_pages.get_allocator().resource()->allocate(pageSize * sizeof(std::uint32_t), alignof(std::uint32_t));
+			m_pages[page] = static_cast<std::uint32_t *>(mem);
+			std::fill(m_pages[page], m_pages[page] + pageSize, npos);
+		}
+		auto &entry = m_pages[page][index & (pageSize - 1)];
+		if (entry == npos) ++m_counts[page];
+		entry = slot;
+	}
+
+	void SparseIndex::reset(std::uint32_t index)
+	{
+		auto page = index >> pageBits;
+		if (page >= m_pages.size() || !m_pages[page]) return;
+		auto &entry = m_pages[page][index & (pageSize - 1)];
+		if (entry != npos) --m_counts[page];
+		entry = npos;
+	}
+
+	std::size_t SparseIndex::releaseEmptyPages()
+	{
+		std::size_t released = 0;
+		for (auto page = m_reservedPages; page < m_pages.size(); ++page)
+		{
+			if (m_pages[page] && m_counts[page] == 0)
+			{
+				freePage(page);
+				++released;
+			}
+		}
+		while (!m_pages.empty() && !m_pages.back())
+		{
+			m_pages.pop_back();
+			m_counts.pop_back();
+		}
+		return released;
+	}
+
+	void SparseIndex::reserve(std::size_t bound)
+	{
+		auto pages = (bound + pageSize - 1) / pageSize;
+		for (std::size_t page = 0; page < pages; ++page)
+		{
+			if (page < m_pages.size() && m_pages[page]) continue;
+			auto index = static_cast<std::uint32_t>(page * pageSize);
+			// Create the page without adding a live entry
+			set(index, 0);
+			reset(index);
+		}
+		m_reservedPages = std::max(m_reservedPages, pages);
+	}
+
+	void SparseIndex::copyFrom(const SparseIndex &other)
+	{
+		for (std::size_t page = 0; page < m_pages.size(); ++page)
+			freePage(page);
+		m_pages.assign(other.m_pages.size(), nullptr);
+		for (std::size_t page = 0; page < m_pages.size(); ++page)
+		{
+			if (!other.m_pages[page]) continue;
+			auto mem = m_pages.get_allocator().resource()->allocate(pageSize * sizeof(std::uint32_t), alignof(std::uint32_t));
+			m_pages[page] = static_cast<std::uint32_t *>(mem);
+			std::copy(other.m_pages[page], other.m_pages[page] + pageSize, m_pages[page]);
+		}
+		m_counts = other.m_counts;
+		m_reservedPages = other.m_reservedPages;
+	}
+
+	void SparseIndex::memoryRanges(std::vector<MemoryRange> &out) const
+	{
+		addMemoryRange(out, m_pages);
+		for (auto page : m_pages)
+		{
+			if (page) out.push_back(MemoryRange{ page, pageSize * sizeof(std::uint32_t) });
+		}
+	}
+
+	bool lockMemory(const void *data, std::size_t size)
+	{
+		if (size == 0) return true;
+#if defined(__unix__) || defined(__APPLE__)
+		return mlock(data, size) == 0;
+#else
+		return false;
+#endif
+	}
+
+	struct EntityRegistry::PagingState
+	{
+		struct Record
+		{
+			std::uint64_t offset;
+			std::uint32_t size;
+		};
+
+		explicit PagingState(std::pmr::memory_resource *resource) :
+			lru{ resource }, lruPos{ resource }, paged{ resource }
+		{}
+
+		void lruRemove(std::uint32_t index)
+		{
+			auto it = lruPos.find(index);
+			if (it == std::end(lruPos)) return;
+			lru.erase(it->second);
+			lruPos.erase(it);
+		}
+		void lruTouch(std::uint32_t index)
+		{
+			auto it = lruPos.find(index);
+			if (it != std::end(lruPos))
+			{
+				// Already tracked; relink the node instead of reallocating it
+				lru.splice(std::begin(lru), lru, it->second);
+				return;
+			}
+			lru.push_front(index);
+			lruPos.emplace(index, std::begin(lru));
+		}
+
+		PageFile file;
+		// Resident inactive entities, most recently used first
+		std::pmr::list<std::uint32_t> lru;
+		std::pmr::unordered_map<std::uint32_t, std::pmr::list<std::uint32_t>::iterator> lruPos;
+		// Evicted entities. A record is a count followed by (type id, byte count,
+		// bytes padded to 8) per component.
+		std::pmr::unordered_map<std::uint32_t, Record> paged;
+		std::size_t pagedOut = 0;
+		std::size_t pagedIn = 0;
+	};
+
+	namespace
+	{
+		inline std::size_t padTo8(std::size_t n)
+		{
+			return (n + 7) & ~std::size_t{ 7 };
+		}
+	}
+
+	EntityRegistry::EntityRegistry(std::pmr::memory_resource *resource) :
+		m_generation{ resource }, m_free{ resource }, m_inactive{ resource }, m_tags{ resource },
+		m_pools{ resource }, m_groups{ resource }, m_regroup{ resource }, m_buffered{ resource }, m_alive{ 0 }
+	{}
+
+	EntityRegistry::~EntityRegistry() = default;
+
+	std::unique_ptr<EntityRegistry> EntityRegistry::clone(std::pmr::memory_resource *resource) const
+	{
+		if (m_paging && !m_paging->paged.empty()) return nullptr;
+		auto rp = std::make_unique<EntityRegistry>(resource);
+		rp->m_generation = m_generation;
+		rp->m_free = m_free;
+		rp->m_inactive = m_inactive;
+		rp->m_tags = m_tags;
+		rp->m_alive = m_alive;
+		rp->m_frame = m_frame;
+		rp->m_pools.resize(m_pools.size());
+		for (std::size_t tid = 0; tid < m_pools.size(); ++tid)
+		{
+			if (!m_pools[tid]) continue;
+			auto pp = m_pools[tid]->clone(resource);
+			if (!pp) return nullptr;
+			if (auto bp = dynamic_cast<BufferedPoolBase *>(pp.get()))
+			{
+				bp->publish(m_frame);
+				rp->m_buffered.push_back(bp);
+			}
+			rp->m_pools[tid] = std::move(pp);
+		}
+		for (auto regroup : m_regroup)
+		{
+			if (regroup) regroup(*rp);
+		}
+		return rp;
+	}
+
+	EntityId EntityRegistry::create()
+	{
+		++m_alive;
+		EntityId id;
+		if (!m_free.empty())
+		{
+			auto index = m_free.back();
+			m_free.pop_back();
+			id = EntityId{ index, m_generation[index] };
+		}
+		else
+		{
+			auto index = static_cast<std::uint32_t>(m_generation.size());
+			m_generation.push_back(0);
+			if ((index >> 6) >= m_inactive.size()) m_inactive.push_back(0);
+			id = EntityId{ index, 0 };
+		}
+		if (m_observer) m_observer->onCreate(id);
+		return id;
+	}
+
+	void EntityRegistry::restore(EntityId id)
+	{
+		while (m_generation.size() <= id.index)
+		{
+			m_free.push_back(static_cast<std::uint32_t>(m_generation.size()));
+			m_generation.push_back(0);
+		}
+		m_inactive.resize((m_generation.size() + 63) / 64, 0);
+		// Replayed creates normally take the index create() would have handed out;
+		// an index that is not free is live already
+		auto fp = std::find(m_free.rbegin(), m_free.rend(), id.index);
+		if (fp == m_free.rend()) return;
+		m_free.erase(std::next(fp).base());
+		m_generation[id.index] = id.generation;
+		++m_alive;
+	}
+
+	void EntityRegistry::destroy(EntityId id)
+	{
+		if (!valid(id)) return;
+		if (m_observer) m_observer->onDestroy(id);
+		if (m_paging) forgetPaged(id.index);
+		for (auto &pp : m_pools)
+		{
+			if (pp) pp->remove(id);
+		}
+		if (!m_tags.empty()) m_tags.erase(id.index);
+		m_inactive[id.index >> 6] &= ~(std::uint64_t{ 1 } << (id.index & 63));
+		++m_generation[id.index];
+		m_free.push_back(id.index);
+		--m_alive;
+	}
+
+	void EntityRegistry::destroy(const std::vector<EntityId> &ids)
+	{
+		std::pmr::vector<EntityId> dead{ resource() };
+		dead.reserve(ids.size());
+		for (auto id : ids)
+		{
+			if (!valid(id)) continue;
+			if (m_observer) m_observer->onDestroy(id);
+			if (m_paging) forgetPaged(id.index);
+			if (!m_tags.empty()) m_tags.erase(id.index);
+			m_inactive[id.index >> 6] &= ~(std::uint64_t{ 1 } << (id.index & 63));
+			// Invalidates repeats of id in the batch
+			++m_generation[id.index];
+			m_free.push_back(id.index);
+			--m_alive;
+			dead.push_back(id);
+		}
+		if (dead.empty()) return;
+		for (auto &pp : m_pools)
+		{
+			if (pp) pp->removeMany(dead.data(), dead.size());
+		}
+	}
+
+	void EntityRegistry::setActive(EntityId id, bool b)
+	{
+		if (!valid(id) || active(id) == b) return;
+		auto bit = std::uint64_t{ 1 } << (id.index & 63);
+		if (b) m_inactive[id.index >> 6] &= ~bit;
+		else m_inactive[id.index >> 6] |= bit;
+		if (m_observer) m_observer->onActiveChanged(id, b);
+		if (m_paging)
+		{
+			if (!b) m_paging->lruTouch(id.index);
+			else
+			{
+				m_paging->lruRemove(id.index);
+				if (m_paging->paged.count(id.index)) pageIn(id.index);
+			}
+		}
+		for (auto &pp : m_pools)
+		{
+			if (pp && pp->contains(id)) pp->onActiveChanged(id, b);
+		}
+	}
+
+	void EntityRegistry::reserveEntities(std::size_t n)
+	{
+		m_generation.reserve(n);
+		m_free.reserve(n);
+		m_inactive.reserve((n + 63) / 64);
+	}
+
+	bool EntityRegistry::warmup(bool lock)
+	{
+		auto touch = [](auto &v)
+		{
+			auto size = v.size();
+			v.resize(v.capacity());
+			v.resize(size);
+		};
+		touch(m_generation);
+		touch(m_free);
+		touch(m_inactive);
+		for (auto &pp : m_pools)
+		{
+			if (pp) pp->prefault();
+		}
+		if (!lock) return true;
+		std::vector<MemoryRange> ranges;
+		addMemoryRange(ranges, m_generation);
+		addMemoryRange(ranges, m_free);
+		addMemoryRange(ranges, m_inactive);
+		for (auto &pp : m_pools)
+		{
+			if (pp) pp->memoryRanges(ranges);
+		}
+		auto ok = true;
+		for (auto &r : ranges)
+			ok = lockMemory(r.data, r.size) && ok;
+		return ok;
+	}
+
+	void EntityRegistry::compact(std::size_t budget)
+	{
+		if (m_pools.empty()) return;
+		std::size_t spent = 0;
+		for (std::size_t n = 0; n < m_pools.size() && spent < budget; ++n)
+		{
+			auto &pp = m_pools[m_compactPool];
+			m_compactPool = (m_compactPool + 1) % m_pools.size();
+			if (pp) spent += pp->compact(budget - spent);
+		}
+	}
+
+	void EntityRegistry::shrinkToFit()
+	{
+		for (auto &pp : m_pools)
+		{
+			if (pp) pp->shrinkToFit();
+		}
+	}
+
+	void EntityRegistry::swapBuffers()
+	{
+		++m_frame;
+		for (auto bp : m_buffered)
+			bp->publish(m_frame);
+	}
+
+	std::uint64_t EntityRegistry::acquireFrontBuffers()
+	{
+		for (;;)
+		{
+			std::uint64_t newest = 0;
+			bool consistent = true;
+			for (std::size_t i = 0; i < m_buffered.size(); ++i)
+			{
+				auto frame = m_buffered[i]->acquireFront();
+				if (i > 0 && frame != newest) consistent = false;
+				newest = std::max(newest, frame);
+			}
+			// A swap was in progress; the lagging pools catch up once it finishes
+			if (consistent) return newest;
+			std::this_thread::yield();
+		}
+	}
+
+	EntityRange EntityRegistry::reserveRange(std::size_t count)
+	{
+		auto first = static_cast<std::uint32_t>(m_generation.size());
+		m_generation.resize(first + count, reservedGeneration);
+		m_inactive.resize((m_generation.size() + 63) / 64, 0);
+		return EntityRange{ first, static_cast<std::uint32_t>(count) };
+	}
+
+	bool EntityRegistry::merge(Partition &partition)
+	{
+		auto &staged = partition.m_pools;
+		for (std::size_t tid = 0; tid < staged.size() && tid < m_pools.size(); ++tid)
+		{
+			if (staged[tid] && m_pools[tid] && !m_pools[tid]->canAbsorb()) return false;
+		}
+		auto range = partition.m_range;
+		for (std::uint32_t i = 0; i < range.count; ++i)
+		{
+			m_generation[range.first + i] = 0;
+			if (i >= partition.m_used) m_free.push_back(range.first + i);
+		}
+		m_alive += partition.m_used;
+		if (staged.size() > m_pools.size()) m_pools.resize(staged.size());
+		for (std::size_t tid = 0; tid < staged.size(); ++tid)
+		{
+			if (!staged[tid]) continue;
+			if (m_pools[tid])
+			{
+				m_pools[tid]->absorb(*staged[tid]);
+				staged[tid].reset();
+				continue;
+			}
+			if (auto bp = dynamic_cast<BufferedPoolBase *>(staged[tid].get()))
+			{
+				bp->publish(m_frame);
+				m_buffered.push_back(bp);
+			}
+			m_pools[tid] = std::move(staged[tid]);
+		}
+		for (auto &t : partition.m_tags)
+			m_tags[t.first] = std::move(t.second);
+		partition.m_tags.clear();
+		partition.m_range = EntityRange{ 0, 0 };
+		partition.m_used = 0;
+		if (m_observer) m_observer->onMerged(range);
+		return true;
+	}
+
+	void EntityRegistry::unload(EntityRange range)
+	{
+		if (m_observer)
+		{
+			// Only live entities are reported; free and reserved indices have nothing to destroy
+			std::pmr::vector<std::uint8_t> isFree(range.count, 0, resource());
+			for (auto index : m_free)
+			{
+				if (index - range.first < range.count) isFree[index - range.first] = 1;
+			}
+			for (auto index = range.first; index < range.first + range.count; ++index)
+			{
+				EntityId id{ index, m_generation[index] };
+				if (!isFree[index - range.first] && valid(id)) m_observer->onDestroy(id);
+			}
+		}
+		for (auto &pp : m_pools)
+		{
+			if (pp) pp->removeRange(range);
+		}
+		// Indices of entities destroyed earlier are on the free list already
+		auto freed = std::remove_if(std::begin(m_free), std::end(m_free), [range](std::uint32_t index)
+		{
+			return index - range.first < range.count;
+		});
+		std::size_t dead = std::end(m_free) - freed;
+		m_free.erase(freed, std::end(m_free));
+		for (auto index = range.first; index < range.first + range.count; ++index)
+		{
+			if (m_paging) forgetPaged(index);
+			if (m_generation[index] == reservedGeneration)
+			{
+				m_generation[index] = 0;
+				++dead;
+			}
+			else ++m_generation[index];
+			if (!m_tags.empty()) m_tags.erase(index);
+			m_inactive[index >> 6] &= ~(std::uint64_t{ 1 } << (index & 63));
+			m_free.push_back(index);
+		}
+		m_alive -= range.count - dead;
+	}
+
+	bool EntityRegistry::enablePaging(const std::string &path)
+	{
+		if (m_paging && !m_paging->paged.empty()) return false;
+		m_paging = std::make_unique<PagingState>(resource());
+		if (!m_paging->file.open(path))
+		{
+			m_paging.reset();
+			return false;
+		}
+		// Inactive bits are only ever set for live entities
+		for (std::uint32_t index = 0; index < m_generation.size(); ++index)
+		{
+			if (m_inactive[index >> 6] & (std::uint64_t{ 1 } << (index & 63))) m_paging->lruTouch(index);
+		}
+		return true;
+	}
+
+	bool EntityRegistry::evict(EntityId id)
+	{
+		if (!m_paging || !valid(id) || active(id) || m_paging->paged.count(id.index)) return false;
+		std::size_t size = sizeof(std::uint32_t);
+		std::uint32_t count = 0;
+		for (auto &pp : m_pools)
+		{
+			if (!pp || !pp->pagedSize() || !pp->contains(id)) continue;
+			size += 2 * sizeof(std::uint32_t) + padTo8(pp->pagedSize());
+			++count;
+		}
+		if (!count) return false;
+		auto offset = m_paging->file.allocate(size);
+		auto out = m_paging->file.at(offset);
+		std::memcpy(out, &count, sizeof(count));
+		out += sizeof(std::uint32_t);
+		for (std::size_t tid = 0; tid < m_pools.size(); ++tid)
+		{
+			auto &pp = m_pools[tid];
+			if (!pp || !pp->pagedSize() || !pp->contains(id)) continue;
+			std::uint32_t header[2] = { static_cast<std::uint32_t>(tid), static_cast<std::uint32_t>(pp->pagedSize()) };
+			std::memcpy(out, header, sizeof(header));
+			out += sizeof(header);
+			pp->pageOut(id, out);
+			out += padTo8(header[1]);
+		}
+		m_paging->paged.emplace(id.index, PagingState::Record{ offset, static_cast<std::uint32_t>(size) });
+		m_paging->lruRemove(id.index);
+		++m_paging->pagedOut;
+		return true;
+	}
+
+	std::size_t EntityRegistry::evictInactive(std::size_t maxResident)
+	{
+		if (!m_paging) return 0;
+		std::size_t evicted = 0;
+		while (m_paging->lru.size() > maxResident)
+		{
+			auto index = m_paging->lru.back();
+			if (evict(EntityId{ index, m_generation[index] })) ++evicted;
+			// Nothing pageable; it stays resident but is no longer a candidate
+			else m_paging->lruRemove(index);
+		}
+		return evicted;
+	}
+
+	EntityRegistry::PagingStats EntityRegistry::pagingStats() const
+	{
+		if (!m_paging) return PagingStats{ 0, 0, 0, 0, 0 };
+		return PagingStats{ m_paging->pagedOut, m_paging->pagedIn, m_paging->paged.size(),
+			m_paging->lru.size(), m_paging->file.fileSize() };
+	}
+
+	void EntityRegistry::touchPaged(EntityId id)
+	{
+		if (!valid(id)) return;
+		if (m_paging->paged.count(id.index)) pageIn(id.index);
+		else if (!active(id)) m_paging->lruTouch(id.index);
+	}
+
+	bool EntityRegistry::pagedHas(EntityId id, std::size_t tid) const
+	{
+		if (!valid(id)) return false;
+		auto it = m_paging->paged.find(id.index);
+		if (it == std::end(m_paging->paged)) return false;
+		auto in = m_paging->file.at(it->second.offset);
+		std::uint32_t count;
+		std::memcpy(&count, in, sizeof(count));
+		in += sizeof(std::uint32_t);
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			std::uint32_t header[2];
+			std::memcpy(header, in, sizeof(header));
+			if (header[0] == tid) return true;
+			in += sizeof(header) + padTo8(header[1]);
+		}
+		return false;
+	}
+
+	void EntityRegistry::pageIn(std::uint32_t index)
+	{
+		auto it = m_paging->paged.find(index);
+		auto record = it->second;
+		m_paging->paged.erase(it);
+		EntityId id{ index, m_generation[index] };
+		auto in = m_paging->file.at(record.offset);
+		std::uint32_t count;
+		std::memcpy(&count, in, sizeof(count));
+		in += sizeof(std::uint32_t);
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			std::uint32_t header[2];
+			std::memcpy(header, in, sizeof(header));
+			in += sizeof(header);
+			m_pools[header[0]]->pageIn(id, in);
+			in += padTo8(header[1]);
+		}
+		m_paging->file.release(record.offset, record.size);
+		++m_paging->pagedIn;
+		if (!active(id)) m_paging->lruTouch(index);
+	}
+
+	void EntityRegistry::forgetPaged(std::uint32_t index)
+	{
+		auto it = m_paging->paged.find(index);
+		if (it != std::end(m_paging->paged))
+		{
+			m_paging->file.release(it->second.offset, it->second.size);
+			m_paging->paged.erase(it);
+		}
+		m_paging->lruRemove(index);
+	}
+
+	void EntityRegistry::addTag(EntityId id, const std::string &tag)
+	{
+		if (!valid(id)) return;
+		m_tags[id.index].emplace_back(tag);
+		if (m_observer) m_observer->onTagAdded(id, tag);
+	}
+
+	bool EntityRegistry::hasTag(EntityId id, const std::string &tag) const
+	{
+		if (!valid(id)) return false;
+		auto it = m_tags.find(id.index);
+		if (it == std::end(m_tags)) return false;
+		return std::find(std::begin(it->second), std::end(it->second), tag) != std::end(it->second);
+	}
+
+	void EntityRegistry::removeTag(EntityId id, const std::string &tag)
+	{
+		if (!valid(id)) return;
+		auto it = m_tags.find(id.index);
+		if (it == std::end(m_tags)) return;
+		auto tp = std::find(std::begin(it->second), std::end(it->second), tag);
+		if (tp == std::end(it->second)) return;
+		it->second.erase(tp);
+		if (it->second.empty()) m_tags.erase(it);
+		if (m_observer) m_observer->onTagRemoved(id, tag);
+	}
+
+	const std::vector<std::string> &EntityRegistry::getTags(EntityId id) const
+	{
+		static const std::vector<std::string> noTags;
+		if (!valid(id)) return noTags;
+		auto it = m_tags.find(id.index);
+		if (it == std::end(m_tags)) return noTags;
+		return it->second;
+	}
+}
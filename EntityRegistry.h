@@ -0,0 +1,1312 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <memory_resource>
+#include <cstring>
+
+namespace sde
+{
+
+	/* EntityId - Compact handle for an entity held by an EntityRegistry. The
+	generation is bumped whenever an index is recycled, so stale handles can be
+	detected with EntityRegistry::valid.
+	*/
+
+	struct EntityId
+	{
+		std::uint32_t index;
+		std::uint32_t generation;
+	};
+
+	inline bool operator==(EntityId a, EntityId b)
+	{
+		return a.index == b.index && a.generation == b.generation;
+	}
+
+	inline bool operator!=(EntityId a, EntityId b)
+	{
+		return !(a == b);
+	}
+
+	constexpr EntityId nullEntity{ 0xffffffffu, 0 };
+
+	// Consecutive entity indices [first, first + count), see EntityRegistry::reserveRange
+	struct EntityRange
+	{
+		std::uint32_t first;
+		std::uint32_t count;
+	};
+
+	/* componentTypeId - Small dense integer per component type, used to index pool
+	tables directly instead of hashing type_index.
+	*/
+
+	std::size_t nextComponentTypeId();
+
+	template<typename T>
+	std::size_t componentTypeId()
+	{
+		static const std::size_t id = nextComponentTypeId();
+		return id;
+	}
+
+	/* ResourcePtr - Owning pointer to a polymorphic object allocated from a memory
+	resource, which gets the memory back when the pointer lets go. The registry
+	holds its pools and groups this way, so they live in its resource too.
+	makeResourcePtr constructs a T there.
+	*/
+
+	template<typename BaseT>
+	struct ResourceDeleter
+	{
+		ResourceDeleter() = default;
+		ResourceDeleter(std::pmr::memory_resource *r, std::size_t s, std::size_t a) :
+			resource{ r }, size{ s }, align{ a }
+		{}
+		template<typename U>
+		ResourceDeleter(const ResourceDeleter<U> &other) :
+			resource{ other.resource }, size{ other.size }, align{ other.align }
+		{}
+		void operator()(BaseT *p) const
+		{
+			// Finds the start of the allocation from any base
+			auto mem = dynamic_cast<void *>(p);
+			p->~BaseT();
+			resource->deallocate(mem, size, align);
+		}
+
+		std::pmr::memory_resource *resource = nullptr;
+		std::size_t size = 0;
+		std::size_t align = 0;
+	};
+
+	template<typename BaseT>
+	using ResourcePtr = std::unique_ptr<BaseT, ResourceDeleter<BaseT>>;
+
+	template<typename T, typename ...Args>
+	ResourcePtr<T> makeResourcePtr(std::pmr::memory_resource *resource, Args &&...args)
+	{
+		static_assert(std::has_virtual_destructor<T>::value, "ResourcePtr holds polymorphic objects");
+		auto mem = resource->allocate(sizeof(T), alignof(T));
+		try
+		{
+			return ResourcePtr<T>{ new (mem) T(std::forward<Args>(args)...), ResourceDeleter<T>{ resource, sizeof(T), alignof(T) } };
+		}
+		catch (...)
+		{
+			resource->deallocate(mem, sizeof(T), alignof(T));
+			throw;
+		}
+	}
+
+	/* MemoryRange - A block of memory held by a registry table or pool, see
+	EntityRegistry::warmup. addMemoryRange reports a vector's whole capacity.
+	*/
+
+	struct MemoryRange
+	{
+		const void *data;
+		std::size_t size;
+	};
+
+	template<typename V>
+	void addMemoryRange(std::vector<MemoryRange> &out, const V &v)
+	{
+		if (v.capacity()) out.push_back(MemoryRange{ v.data(), v.capacity() * sizeof(typename V::value_type) });
+	}
+
+	/* lockMemory - Pins the pages of [data, data + size) in RAM (mlock) so they
+	cannot be paged out. Returns false where unsupported or refused, e.g. when
+	RLIMIT_MEMLOCK is too low.
+	*/
+
+	bool lockMemory(const void *data, std::size_t size);
+
+	/* SparseIndex - Paged map from entity index to a dense slot. Pages are only
+	allocated once an index inside them is used, so a component type that lives on
+	a few entities does not pay for the whole index range. Pages and the page table
+	come from the memory resource given at construction.
+	*/
+
+	class SparseIndex
+	{
+	public:
+		static constexpr std::uint32_t npos = 0xffffffffu;
+		static constexpr std::uint32_t pageBits = 12;
+		static constexpr std::uint32_t pageSize = 1u << pageBits;
+
+		explicit SparseIndex(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_pages{ resource }, m_counts{ resource }
+		{}
+		~SparseIndex();
+		SparseIndex(const SparseIndex &other) = delete;
+		SparseIndex &operator=(const SparseIndex &other) = delete;
+
+		inline std::uint32_t get(std::uint32_t index) const
+		{
+			auto page = index >> pageBits;
+			if (page >= m_pages.size() || !m_pages[page]) return npos;
+			return m_pages[page][index & (pageSize - 1)];
+		}
+		void set(std::uint32_t index, std::uint32_t slot);
+		void reset(std::uint32_t index);
+		// Frees pages with no live entries; returns the number released
+		std::size_t releaseEmptyPages();
+		inline bool hasPage(std::uint32_t index) const
+		{
+			auto page = index >> pageBits;
+			return page < m_pages.size() && m_pages[page];
+		}
+		// One past the highest index that can currently hold an entry
+		inline std::size_t indexBound() const
+		{
+			return m_pages.size() * std::size_t{ pageSize };
+		}
+		// Allocates every page below bound now; they are kept by releaseEmptyPages
+		void reserve(std::size_t bound);
+		// Replaces the contents with a copy of other, keeping this index's resource
+		void copyFrom(const SparseIndex &other);
+		// The page table and every allocated page
+		void memoryRanges(std::vector<MemoryRange> &out) const;
+	private:
+		void freePage(std::size_t page);
+
+		std::pmr::vector<std::uint32_t *> m_pages;
+		// Live entries per page
+		std::pmr::vector<std::uint32_t> m_counts;
+		std::size_t m_reservedPages = 0;
+	};
+
+	/* PoolBase - Type-erased part of a component pool: the entity-to-slot index and
+	the dense list of owning entities. Pools allocate from the memory resource they
+	are constructed with; the registry passes its own, so pools are expected to
+	provide a constructor taking a std::pmr::memory_resource *.
+	*/
+
+	class PoolBase
+	{
+	public:
+		explicit PoolBase(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_sparse{ resource }, m_entities{ resource }
+		{}
+		virtual ~PoolBase()
+		{}
+		inline std::pmr::memory_resource *resource() const
+		{
+			return m_entities.get_allocator().resource();
+		}
+		virtual void remove(EntityId id) = 0;
+		// Called by the registry when an entity's active state actually changes
+		virtual void onActiveChanged(EntityId, bool)
+		{}
+		// One bounded slice of maintenance work, see EntityRegistry::compact.
+		// Returns the number of elements moved.
+		virtual std::size_t compact(std::size_t)
+		{
+			m_sparse.releaseEmptyPages();
+			return 0;
+		}
+		// Releases spare capacity above what was reserved, see EntityRegistry::shrinkToFit
+		virtual void shrinkToFit()
+		{}
+		inline bool contains(EntityId id) const
+		{
+			return findSlot(id) != SparseIndex::npos;
+		}
+		inline std::size_t size() const
+		{
+			return m_entities.size();
+		}
+		inline const std::pmr::vector<EntityId> &entities() const
+		{
+			return m_entities;
+		}
+		// Capacity for count elements and sparse pages for entity indices below indexBound
+		virtual void reserve(std::size_t count, std::size_t indexBound)
+		{
+			m_entities.reserve(count);
+			m_sparse.reserve(indexBound);
+		}
+		// Touches reserved capacity so its pages are resident before the first frame
+		virtual void prefault()
+		{
+			touchCapacity(m_entities);
+		}
+		// Appends the blocks the pool has allocated, for EntityRegistry::warmup to lock
+		virtual void memoryRanges(std::vector<MemoryRange> &out) const
+		{
+			m_sparse.memoryRanges(out);
+			addMemoryRange(out, m_entities);
+		}
+		// Copy of the pool allocating from resource, or nullptr if it cannot be copied;
+		// see EntityRegistry::clone
+		virtual ResourcePtr<PoolBase> clone(std::pmr::memory_resource *) const
+		{
+			return nullptr;
+		}
+		// Merging of staged partitions, see EntityRegistry::merge. absorb appends every
+		// element of other, a pool of the same type whose entities are all new to this
+		// one, and consumes it. Only called when canAbsorb returns true.
+		virtual bool canAbsorb() const
+		{
+			return false;
+		}
+		virtual void absorb(PoolBase &)
+		{}
+		// Paging, see EntityRegistry::enablePaging. A pool whose pagedSize is non-zero
+		// stores each element as that many bytes: pageOut writes id's element and
+		// removes it, pageIn adds it back from the bytes.
+		virtual std::size_t pagedSize() const
+		{
+			return 0;
+		}
+		virtual void pageOut(EntityId, void *)
+		{}
+		virtual void pageIn(EntityId, const void *)
+		{}
+		// Removes every id present; pools whose removal is not O(1) do it in one pass
+		virtual void removeMany(const EntityId *ids, std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				remove(ids[i]);
+		}
+		// Removes every entity whose index lies in range
+		virtual void removeRange(EntityRange range)
+		{
+			for (auto index = range.first; index < range.first + range.count; ++index)
+			{
+				if (!m_sparse.hasPage(index))
+				{
+					index |= SparseIndex::pageSize - 1;
+					continue;
+				}
+				auto slot = m_sparse.get(index);
+				if (slot != SparseIndex::npos) remove(m_entities[slot]);
+			}
+			m_sparse.releaseEmptyPages();
+		}
+	protected:
+		// Dense slot of id, or npos if the pool holds nothing for it; an id whose index
+		// was recycled does not match the entity stored there
+		inline std::uint32_t findSlot(EntityId id) const
+		{
+			auto slot = m_sparse.get(id.index);
+			return (slot == SparseIndex::npos || m_entities[slot] != id) ? SparseIndex::npos : slot;
+		}
+		// Appends id to the entity list and indexes it; the pool appends its data to match
+		std::uint32_t addEntity(EntityId id)
+		{
+			auto slot = static_cast<std::uint32_t>(m_entities.size());
+			m_sparse.set(id.index, slot);
+			m_entities.push_back(id);
+			return slot;
+		}
+		// Swap-with-last removal of the entity at slot. Returns the old last slot; the
+		// pool then moves its data the same way with eraseFromColumns.
+		std::uint32_t eraseSlot(std::uint32_t slot)
+		{
+			auto last = static_cast<std::uint32_t>(m_entities.size() - 1);
+			m_sparse.reset(m_entities[slot].index);
+			if (slot != last)
+			{
+				m_entities[slot] = m_entities[last];
+				m_sparse.set(m_entities[slot].index, slot);
+			}
+			m_entities.pop_back();
+			return last;
+		}
+		template<typename ...Vs>
+		static void eraseFromColumns(std::uint32_t slot, std::uint32_t last, Vs &...columns)
+		{
+			if (slot != last) ((columns[slot] = std::move(columns[last])), ...);
+			(columns.pop_back(), ...);
+		}
+		// Copies the sparse index and entity list of other into this pool
+		void copyBase(const PoolBase &other)
+		{
+			m_sparse.copyFrom(other.m_sparse);
+			m_entities = other.m_entities;
+		}
+		// Appends the entities of other and indexes them; returns the first new slot
+		std::size_t appendEntities(const PoolBase &other)
+		{
+			auto base = m_entities.size();
+			m_entities.insert(std::end(m_entities), std::begin(other.m_entities), std::end(other.m_entities));
+			for (auto i = base; i < m_entities.size(); ++i)
+				m_sparse.set(m_entities[i].index, static_cast<std::uint32_t>(i));
+			return base;
+		}
+		// Writes every element of a vector's spare capacity, for types that allow it
+		template<typename V>
+		static void touchCapacity(V &v)
+		{
+			using E = typename V::value_type;
+			if constexpr (std::is_trivially_default_constructible<E>::value && std::is_trivially_destructible<E>::value)
+			{
+				auto size = v.size();
+				v.resize(v.capacity());
+				v.resize(size);
+			}
+		}
+
+		SparseIndex m_sparse;
+		std::pmr::vector<EntityId> m_entities;
+	};
+
+	/* BufferedPoolBase - Pools whose contents are handed to a reader thread once per
+	tick, see BufferedPool and EntityRegistry::swapBuffers.
+	*/
+
+	class BufferedPoolBase : public PoolBase
+	{
+	public:
+		using PoolBase::PoolBase;
+		// Writer: publishes the back buffer as frame
+		virtual void publish(std::uint64_t frame) = 0;
+		// Reader: moves to the newest published buffer; returns its frame
+		virtual std::uint64_t acquireFront() = 0;
+	};
+
+	/* GroupBase - Receives structural changes from the pools a group owns.
+	*/
+
+	class GroupBase
+	{
+	public:
+		virtual ~GroupBase()
+		{}
+		// Called after id gained a component in an owned pool
+		virtual void onAdd(EntityId id) = 0;
+		// Called before id loses a component in an owned pool
+		virtual void onRemove(EntityId id) = 0;
+	};
+
+	/* ComponentPool - Dense storage for every component of type T in a registry.
+	Components are plain values kept contiguous; removal swaps the last element
+	into the hole. Pointers and references are invalidated by add and remove.
+
+	A pool can be given an order with setOrder. Removal then preserves the order,
+	and sort() restores it after keys change or components are added, using an
+	insertion sort that is close to linear when little moved since the last frame.
+	Removing one component from an ordered pool shifts the tail, O(n); removeMany
+	and removeRange (EntityRegistry's batch destroy and unload) mark the removed
+	slots and close the gaps in a single pass.
+	Pools owned by an OwningGroup keep the group's layout instead, so they cannot
+	be given an order and sort() leaves them alone.
+	*/
+
+	template<typename T>
+	class ComponentPool : public PoolBase
+	{
+	public:
+		explicit ComponentPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			PoolBase{ resource }, m_data{ resource }
+		{}
+
+		template<typename ...Args>
+		T &emplace(EntityId id, Args &&...args)
+		{
+			auto slot = findSlot(id);
+			if (slot != SparseIndex::npos)
+			{
+				m_data[slot] = T{ std::forward<Args>(args)... };
+				return m_data[slot];
+			}
+			addEntity(id);
+			m_data.push_back(T{ std::forward<Args>(args)... });
+			if (!m_owner) return m_data.back();
+			m_owner->onAdd(id);
+			return m_data[m_sparse.get(id.index)];
+		}
+		inline T *find(EntityId id)
+		{
+			auto slot = findSlot(id);
+			return slot == SparseIndex::npos ? nullptr : &m_data[slot];
+		}
+		void remove(EntityId id) override
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			if (m_owner)
+			{
+				m_owner->onRemove(id);
+				slot = m_sparse.get(id.index);
+			}
+			if (m_order)
+			{
+				m_entities[slot] = nullEntity;
+				m_sparse.reset(id.index);
+				sweep(slot);
+				return;
+			}
+			auto last = eraseSlot(slot);
+			eraseFromColumns(slot, last, m_data);
+		}
+		void removeMany(const EntityId *ids, std::size_t count) override
+		{
+			if (!m_order || count < 2)
+			{
+				PoolBase::removeMany(ids, count);
+				return;
+			}
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				if (!contains(ids[i])) continue;
+				m_entities[m_sparse.get(ids[i].index)] = nullEntity;
+				m_sparse.reset(ids[i].index);
+			}
+			sweep();
+		}
+		void removeRange(EntityRange range) override
+		{
+			if (!m_order)
+			{
+				PoolBase::removeRange(range);
+				return;
+			}
+			for (auto &id : m_entities)
+			{
+				if (id.index - range.first >= range.count) continue;
+				m_sparse.reset(id.index);
+				id = nullEntity;
+			}
+			sweep();
+			m_sparse.releaseEmptyPages();
+		}
+		inline T *data()
+		{
+			return m_data.data();
+		}
+
+		// Ordering
+
+		bool setOrder(std::function<bool(const T &, const T &)> comp)
+		{
+			if (m_owner) return false;
+			m_order = std::move(comp);
+			sort();
+			return true;
+		}
+		void sort()
+		{
+			if (m_order) sort(m_order);
+		}
+		inline bool ordered() const
+		{
+			return static_cast<bool>(m_order);
+		}
+		// Incremental insertion sort: cheap when the pool is nearly sorted already
+		template<typename Compare>
+		void sort(Compare comp)
+		{
+			if (m_owner) return;
+			auto count = m_data.size();
+			auto lowest = count;
+			for (std::size_t i = 1; i < count; ++i)
+			{
+				if (!comp(m_data[i], m_data[i - 1])) continue;
+				auto value = std::move(m_data[i]);
+				auto id = m_entities[i];
+				auto j = i;
+				for (; j > 0 && comp(value, m_data[j - 1]); --j)
+				{
+					m_data[j] = std::move(m_data[j - 1]);
+					m_entities[j] = m_entities[j - 1];
+				}
+				m_data[j] = std::move(value);
+				m_entities[j] = id;
+				lowest = std::min(lowest, j);
+			}
+			for (auto i = lowest; i < count; ++i)
+				m_sparse.set(m_entities[i].index, static_cast<std::uint32_t>(i));
+		}
+		template<typename F>
+		void each(F f)
+		{
+			for (std::size_t i = 0; i < m_data.size(); ++i)
+				f(m_entities[i], m_data[i]);
+		}
+		void reserve(std::size_t count, std::size_t indexBound) override
+		{
+			PoolBase::reserve(count, indexBound);
+			m_data.reserve(count);
+			m_reserved = std::max(m_reserved, count);
+		}
+		void prefault() override
+		{
+			PoolBase::prefault();
+			touchCapacity(m_data);
+		}
+		void memoryRanges(std::vector<MemoryRange> &out) const override
+		{
+			PoolBase::memoryRanges(out);
+			addMemoryRange(out, m_data);
+		}
+		// Group ownership is not copied; EntityRegistry::clone recreates the groups
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override
+		{
+			if constexpr (std::is_copy_constructible<T>::value)
+			{
+				auto pp = makeResourcePtr<ComponentPool>(resource);
+				pp->copyBase(*this);
+				pp->m_data = m_data;
+				pp->m_order = m_order;
+				pp->m_reserved = m_reserved;
+				return pp;
+			}
+			else return nullptr;
+		}
+		std::size_t pagedSize() const override
+		{
+			return std::is_trivially_copyable<T>::value ? sizeof(T) : 0;
+		}
+		void pageOut(EntityId id, void *out) override
+		{
+			if constexpr (std::is_trivially_copyable<T>::value)
+			{
+				auto cp = find(id);
+				if (!cp) return;
+				std::memcpy(out, cp, sizeof(T));
+				remove(id);
+			}
+		}
+		void pageIn(EntityId id, const void *in) override
+		{
+			if constexpr (std::is_trivially_copyable<T>::value)
+			{
+				alignas(T) unsigned char buffer[sizeof(T)];
+				std::memcpy(buffer, in, sizeof(T));
+				emplace(id, *reinterpret_cast<const T *>(buffer));
+			}
+		}
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		void absorb(PoolBase &other) override
+		{
+			auto &src = static_cast<ComponentPool &>(other);
+			appendEntities(src);
+			m_data.insert(std::end(m_data), std::make_move_iterator(std::begin(src.m_data)), std::make_move_iterator(std::end(src.m_data)));
+			if (m_owner)
+			{
+				for (auto id : src.m_entities)
+					m_owner->onAdd(id);
+			}
+			sort();
+		}
+
+		// Moves survivors into entity index order: walks entity indices upward and swaps
+		// each one present into the next target slot, a selection sort driven by the
+		// sparse index. Each call visits at most budget indices, and a full pass leaves
+		// the pool sorted by entity. Pools that are ordered or owned by a group keep
+		// their layout.
+		std::size_t compact(std::size_t budget) override
+		{
+			std::size_t moved = 0;
+			m_sparse.releaseEmptyPages();
+			if (m_owner || m_order) return 0;
+			for (std::size_t n = 0; n < budget; ++n)
+			{
+				if (m_compactIndex >= m_sparse.indexBound() || m_compactSlot >= m_data.size())
+				{
+					m_compactIndex = 0;
+					m_compactSlot = 0;
+					break;
+				}
+				if (!m_sparse.hasPage(m_compactIndex))
+				{
+					m_compactIndex = (m_compactIndex | (SparseIndex::pageSize - 1)) + 1;
+					continue;
+				}
+				auto slot = m_sparse.get(m_compactIndex++);
+				if (slot == SparseIndex::npos || slot < m_compactSlot) continue;
+				if (slot != m_compactSlot)
+				{
+					swapSlots(slot, m_compactSlot);
+					++moved;
+				}
+				++m_compactSlot;
+			}
+			return moved;
+		}
+
+		void shrinkToFit() override
+		{
+			if (m_data.size() < m_reserved || m_data.capacity() == m_data.size()) return;
+			m_data.shrink_to_fit();
+			m_entities.shrink_to_fit();
+		}
+
+		// Group ownership
+
+		inline GroupBase *owner() const
+		{
+			return m_owner;
+		}
+		bool setOwner(GroupBase *group)
+		{
+			if (group && (m_owner || m_order)) return false;
+			m_owner = group;
+			return true;
+		}
+		inline std::uint32_t slotOf(EntityId id) const
+		{
+			return m_sparse.get(id.index);
+		}
+		void swapSlots(std::uint32_t a, std::uint32_t b)
+		{
+			if (a == b) return;
+			std::swap(m_data[a], m_data[b]);
+			std::swap(m_entities[a], m_entities[b]);
+			m_sparse.set(m_entities[a].index, a);
+			m_sparse.set(m_entities[b].index, b);
+		}
+
+	private:
+		// Closes the gaps left by slots marked nullEntity at or after from, keeping the
+		// order of the rest
+		void sweep(std::size_t from = 0)
+		{
+			auto kept = from;
+			for (auto i = from; i < m_entities.size(); ++i)
+			{
+				if (m_entities[i] == nullEntity) continue;
+				if (i != kept)
+				{
+					m_entities[kept] = m_entities[i];
+					m_data[kept] = std::move(m_data[i]);
+					m_sparse.set(m_entities[kept].index, static_cast<std::uint32_t>(kept));
+				}
+				++kept;
+			}
+			m_entities.erase(std::begin(m_entities) + kept, std::end(m_entities));
+			m_data.erase(std::begin(m_data) + kept, std::end(m_data));
+		}
+
+		std::pmr::vector<T> m_data;
+		std::function<bool(const T &, const T &)> m_order;
+		GroupBase *m_owner = nullptr;
+		std::size_t m_reserved = 0;
+		// Progress of the current compaction pass
+		std::uint32_t m_compactIndex = 0;
+		std::uint32_t m_compactSlot = 0;
+	};
+
+	/* OwningGroup - Opt-in layout for a hot combination of component types. The
+	group owns the pools of Ts... and keeps them co-sorted, so the entities that have
+	every one of the components occupy slots [0, size()) in each pool, in the same
+	order. Iteration walks the pools' arrays in lockstep with no sparse lookups.
+	A pool can be owned by only one group. Create through EntityRegistry::group.
+	*/
+
+	template<typename ...Ts>
+	class OwningGroup : public GroupBase
+	{
+	public:
+		OwningGroup(ComponentPool<Ts> &...pools) :
+			m_pools{ &pools... }, m_size{ 0 }
+		{
+			auto &lead = *std::get<0>(m_pools);
+			for (std::size_t i = 0; i < lead.size(); ++i)
+				onAdd(lead.entities()[i]);
+		}
+		~OwningGroup()
+		{
+			std::apply([](auto *...pp)
+			{
+				(pp->setOwner(nullptr), ...);
+			}, m_pools);
+		}
+		OwningGroup(const OwningGroup &other) = delete;
+		OwningGroup &operator=(const OwningGroup &other) = delete;
+
+		inline std::size_t size() const
+		{
+			return m_size;
+		}
+		inline const EntityId *entities() const
+		{
+			return std::get<0>(m_pools)->entities().data();
+		}
+		// Column of size() components, aligned index for index with every other column
+		template<typename T>
+		inline T *data()
+		{
+			return std::get<ComponentPool<T> *>(m_pools)->data();
+		}
+		// f(EntityId, Ts &...)
+		template<typename F>
+		void each(F f)
+		{
+			auto ids = entities();
+			auto columns = std::make_tuple(std::get<ComponentPool<Ts> *>(m_pools)->data()...);
+			for (std::size_t i = 0; i < m_size; ++i)
+				f(ids[i], std::get<Ts *>(columns)[i]...);
+		}
+
+		void onAdd(EntityId id) override
+		{
+			bool all = true;
+			std::apply([&](auto *...pp)
+			{
+				all = (pp->contains(id) && ...);
+			}, m_pools);
+			if (!all || std::get<0>(m_pools)->slotOf(id) < m_size) return;
+			std::apply([&](auto *...pp)
+			{
+				(pp->swapSlots(pp->slotOf(id), m_size), ...);
+			}, m_pools);
+			++m_size;
+		}
+		void onRemove(EntityId id) override
+		{
+			auto slot = std::get<0>(m_pools)->slotOf(id);
+			if (slot == SparseIndex::npos || slot >= m_size || !std::get<0>(m_pools)->contains(id)) return;
+			--m_size;
+			std::apply([&](auto *...pp)
+			{
+				(pp->swapSlots(pp->slotOf(id), static_cast<std::uint32_t>(m_size)), ...);
+			}, m_pools);
+		}
+
+	private:
+		std::tuple<ComponentPool<Ts> *...> m_pools;
+		std::size_t m_size;
+	};
+
+	/* SharedPool - Flyweight storage for immutable per-archetype data. Equal values
+	are interned once (found by Hash, confirmed with operator==) and reference counted
+	by the entities attached to them; a value is released when its last entity lets
+	go. Entities sharing a value form a group, so systems can hoist per-value work out
+	of the per-entity loop with eachGroup.
+	*/
+
+	template<typename T, typename Hash = std::hash<T>>
+	class SharedPool : public PoolBase
+	{
+	public:
+		explicit SharedPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			PoolBase{ resource }, m_groups{ resource }, m_freeGroups{ resource }, m_index{ resource },
+			m_group{ resource }, m_member{ resource }
+		{}
+
+		const T &set(EntityId id, const T &value)
+		{
+			auto g = intern(value);
+			auto slot = findSlot(id);
+			if (slot != SparseIndex::npos)
+			{
+				if (m_group[slot] != g)
+				{
+					detach(slot);
+					attach(slot, g);
+				}
+				else release(g);
+				return m_groups[g].value;
+			}
+			slot = addEntity(id);
+			m_group.push_back(0);
+			m_member.push_back(0);
+			attach(slot, g);
+			return m_groups[g].value;
+		}
+		inline const T *find(EntityId id) const
+		{
+			auto slot = findSlot(id);
+			return slot == SparseIndex::npos ? nullptr : &m_groups[m_group[slot]].value;
+		}
+		void remove(EntityId id) override
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			detach(slot);
+			auto last = eraseSlot(slot);
+			eraseFromColumns(slot, last, m_group, m_member);
+		}
+		// Number of distinct values currently referenced
+		inline std::size_t groupCount() const
+		{
+			return m_groups.size() - m_freeGroups.size();
+		}
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override
+		{
+			auto pp = makeResourcePtr<SharedPool>(resource);
+			pp->copyBase(*this);
+			pp->m_groups.reserve(m_groups.size());
+			for (auto &grp : m_groups)
+				pp->m_groups.push_back(Group{ grp.value, grp.hash, std::pmr::vector<EntityId>{ grp.members, resource } });
+			pp->m_freeGroups = m_freeGroups;
+			pp->m_index = m_index;
+			pp->m_group = m_group;
+			pp->m_member = m_member;
+			return pp;
+		}
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		void absorb(PoolBase &other) override
+		{
+			auto &src = static_cast<SharedPool &>(other);
+			for (std::size_t slot = 0; slot < src.m_entities.size(); ++slot)
+				set(src.m_entities[slot], src.m_groups[src.m_group[slot]].value);
+		}
+		// f(const T &value, const std::pmr::vector<EntityId> &entities)
+		template<typename F>
+		void eachGroup(F f)
+		{
+			for (auto &grp : m_groups)
+			{
+				if (grp.members.empty()) continue;
+				f(static_cast<const T &>(grp.value), static_cast<const std::pmr::vector<EntityId> &>(grp.members));
+			}
+		}
+	private:
+		struct Group
+		{
+			T value;
+			std::size_t hash;
+			std::pmr::vector<EntityId> members;
+		};
+
+		std::uint32_t intern(const T &value)
+		{
+			auto h = Hash{}(value);
+			auto range = m_index.equal_range(h);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (m_groups[it->second].value == value) return it->second;
+			}
+			std::uint32_t g;
+			if (!m_freeGroups.empty())
+			{
+				g = m_freeGroups.back();
+				m_freeGroups.pop_back();
+				m_groups[g].value = value;
+				m_groups[g].hash = h;
+			}
+			else
+			{
+				g = static_cast<std::uint32_t>(m_groups.size());
+				m_groups.push_back(Group{ value, h, std::pmr::vector<EntityId>{ resource() } });
+			}
+			m_index.emplace(h, g);
+			return g;
+		}
+		// Drops a freshly interned group again if nothing ended up referencing it
+		void release(std::uint32_t g)
+		{
+			if (!m_groups[g].members.empty()) return;
+			auto range = m_index.equal_range(m_groups[g].hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (it->second == g)
+				{
+					m_index.erase(it);
+					break;
+				}
+			}
+			m_freeGroups.push_back(g);
+		}
+		void attach(std::uint32_t slot, std::uint32_t g)
+		{
+			m_group[slot] = g;
+			m_member[slot] = static_cast<std::uint32_t>(m_groups[g].members.size());
+			m_groups[g].members.push_back(m_entities[slot]);
+		}
+		void detach(std::uint32_t slot)
+		{
+			auto g = m_group[slot];
+			auto &members = m_groups[g].members;
+			auto pos = m_member[slot];
+			members[pos] = members.back();
+			m_member[m_sparse.get(members[pos].index)] = pos;
+			members.pop_back();
+			release(g);
+		}
+
+		std::pmr::vector<Group> m_groups;
+		std::pmr::vector<std::uint32_t> m_freeGroups;
+		std::pmr::unordered_multimap<std::size_t, std::uint32_t> m_index;
+		// Per dense slot: the group referenced and the position in its member list
+		std::pmr::vector<std::uint32_t> m_group;
+		std::pmr::vector<std::uint32_t> m_member;
+	};
+
+	class Partition;
+	class Journal;
+
+	/* RegistryObserver - Receives the structural changes made through an
+	EntityRegistry's own interface, see EntityRegistry::setObserver. Changes made
+	on a pool directly, or written through a getComponent pointer, are not seen;
+	report the latter with EntityRegistry::markModified.
+	*/
+
+	class RegistryObserver
+	{
+	public:
+		virtual ~RegistryObserver()
+		{}
+		virtual void onCreate(EntityId)
+		{}
+		virtual void onDestroy(EntityId)
+		{}
+		virtual void onActiveChanged(EntityId, bool)
+		{}
+		// tid is componentTypeId<ComponentPool<T>>() and value points to the stored T
+		virtual void onComponentSet(EntityId, std::size_t, const void *)
+		{}
+		virtual void onComponentRemoved(EntityId, std::size_t)
+		{}
+		virtual void onTagAdded(EntityId, const std::string &)
+		{}
+		virtual void onTagRemoved(EntityId, const std::string &)
+		{}
+		// The live entities of range arrived together through merge
+		virtual void onMerged(EntityRange)
+		{}
+	};
+
+	/* EntityRegistry - Compact entity mode. An entity is only an EntityId; its
+	components live in per-type pools and its tags in a side table that is only
+	populated for entities that actually carry tags. Per-entity overhead is a 32-bit
+	generation and one activity bit, plus one sparse slot per component type used.
+
+	Every table, pool and group is allocated from the memory resource passed to the
+	constructor. With an arena such as std::pmr::monotonic_buffer_resource, a world
+	is torn down by destroying the registry (its destructors no longer free
+	piecemeal into the heap) and then releasing the arena in one step. Tag strings
+	stay on the global heap, so getTags keeps returning std::vector<std::string>.
+	*/
+
+	class EntityRegistry
+	{
+	public:
+		explicit EntityRegistry(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+		~EntityRegistry();
+		EntityRegistry(const EntityRegistry &other) = delete;
+		EntityRegistry &operator=(const EntityRegistry &other) = delete;
+
+		// Independent copy of every entity, component, tag and group, allocated from
+		// resource. Returns nullptr if a pool cannot be copied (a custom pool without
+		// clone, or a component type that is not copyable) or entities are paged out.
+		std::unique_ptr<EntityRegistry> clone(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+		// At most one observer; pass nullptr to detach. Clones start without one.
+		inline void setObserver(RegistryObserver *observer)
+		{
+			m_observer = observer;
+		}
+		inline RegistryObserver *observer() const
+		{
+			return m_observer;
+		}
+
+		EntityId create();
+		void destroy(EntityId id);
+		// Destroys a batch in one pass over each pool, which matters for ordered pools
+		void destroy(const std::vector<EntityId> &ids);
+		inline bool valid(EntityId id) const
+		{
+			return id.index < m_generation.size() && m_generation[id.index] == id.generation && id.generation != reservedGeneration;
+		}
+		inline std::size_t size() const
+		{
+			return m_alive;
+		}
+
+		void setActive(EntityId id, bool b);
+		// False for ids that are not valid
+		inline bool active(EntityId id) const
+		{
+			return valid(id) && !(m_inactive[id.index >> 6] & (std::uint64_t{ 1 } << (id.index & 63)));
+		}
+
+		// Component management. Ids that are not valid are ignored, so a stale handle
+		// never touches the entity that reuses its index.
+
+		// Returns nullptr if id is not valid
+		template<typename T, typename ...Args>
+		T *addComponent(EntityId id, Args &&...args)
+		{
+			if (!valid(id)) return nullptr;
+			touch(id);
+			auto &c = pool<T>().emplace(id, std::forward<Args>(args)...);
+			if (m_observer) m_observer->onComponentSet(id, componentTypeId<ComponentPool<T>>(), &c);
+			return &c;
+		}
+		template<typename T>
+		T *getComponent(EntityId id)
+		{
+			touch(id);
+			auto pp = findPool<ComponentPool<T>>();
+			return pp ? pp->find(id) : nullptr;
+		}
+		template<typename T>
+		bool hasComponent(EntityId id) const
+		{
+			auto tid = componentTypeId<ComponentPool<T>>();
+			if (tid < m_pools.size() && m_pools[tid] && m_pools[tid]->contains(id)) return true;
+			return m_paging && pagedHas(id, tid);
+		}
+		template<typename T>
+		void removeComponent(EntityId id)
+		{
+			if (!valid(id)) return;
+			touch(id);
+			auto pp = findPool<ComponentPool<T>>();
+			if (!pp || !pp->contains(id)) return;
+			pp->remove(id);
+			if (m_observer) m_observer->onComponentRemoved(id, componentTypeId<ComponentPool<T>>());
+		}
+		// Reports a component changed in place to the observer
+		template<typename T>
+		void markModified(EntityId id)
+		{
+			if (!m_observer) return;
+			auto cp = getComponent<T>(id);
+			if (cp) m_observer->onComponentSet(id, componentTypeId<ComponentPool<T>>(), cp);
+		}
+		template<typename T>
+		ComponentPool<T> &pool()
+		{
+			return poolOf<ComponentPool<T>>();
+		}
+		template<typename T, typename F>
+		void each(F f)
+		{
+			auto pp = findPool<ComponentPool<T>>();
+			if (pp) pp->each(f);
+		}
+		template<typename T, typename Compare>
+		void sort(Compare comp)
+		{
+			auto pp = findPool<ComponentPool<T>>();
+			if (pp) pp->sort(comp);
+		}
+
+		// Capacity reservation and warmup. After reserving for the peak load and calling
+		// warmup, the steady state performs no reallocation and touches no fresh pages.
+
+		void reserveEntities(std::size_t n);
+		// Also covers the sparse index for every entity reserved so far, so call it
+		// after reserveEntities. reservePool does the same for a custom pool.
+		template<typename T>
+		void reserveComponents(std::size_t n)
+		{
+			reservePool<ComponentPool<T>>(n);
+		}
+		template<typename PoolT>
+		void reservePool(std::size_t n)
+		{
+			poolOf<PoolT>().reserve(n, std::max(n, m_generation.capacity()));
+		}
+		// Pre-faults all reserved capacity; with lock, also pins the entity tables and
+		// every pool's buffers in RAM (see lockMemory). Returns false if any range
+		// could not be locked. Buffers allocated later, by growth past the
+		// reservation, are not locked.
+		bool warmup(bool lock = false);
+
+		// Incremental defragmentation, meant to be called once per frame with a small
+		// budget. Pools take turns releasing empty sparse pages and moving components
+		// towards entity order until budget components have moved.
+		void compact(std::size_t budget);
+		// Reallocates pools to drop spare capacity, keeping what was reserved. Each
+		// trimmed pool is copied whole, so call it at a quiet point such as a level
+		// change rather than per frame.
+		void shrinkToFit();
+
+		// Double buffering. swapBuffers is called by the simulation thread between ticks
+		// and publishes every BufferedPool as the next frame; acquireFrontBuffers is
+		// called by the render thread and moves all of them to the newest frame they
+		// have in common, which it returns. Buffered pools must exist before the
+		// render thread starts. If a swapBuffers is under way, the pools disagree and
+		// acquireFrontBuffers retries, yielding, until the swap completes. The swap is
+		// one pointer exchange per pool, so the wait is short unless the simulation
+		// thread is descheduled mid-swap; it is not bounded.
+
+		void swapBuffers();
+		std::uint64_t acquireFrontBuffers();
+
+		// Paging. Once enabled, inactive entities can be evicted: the components they
+		// hold in pools with a pagedSize (ComponentPools of trivially copyable types)
+		// are written to a memory-mapped page file and removed from RAM; other storage
+		// stays resident. An evicted entity is paged back in when it is reactivated or
+		// its components are looked up through the registry. Iteration only visits
+		// resident components.
+
+		struct PagingStats
+		{
+			std::size_t pagedOut;
+			std::size_t pagedIn;
+			// Entities currently evicted, and inactive entities still in RAM
+			std::size_t evicted;
+			std::size_t residentInactive;
+			std::size_t fileBytes;
+		};
+
+		// Returns false if the page file cannot be created
+		bool enablePaging(const std::string &path);
+		// Evicts id if it is inactive; returns false if it was not evicted
+		bool evict(EntityId id);
+		// Evicts the least recently used inactive entities until at most maxResident
+		// remain in RAM; returns the number evicted
+		std::size_t evictInactive(std::size_t maxResident);
+		PagingStats pagingStats() const;
+
+		// Streaming partitions. A Partition is built off-thread against a range of
+		// indices reserved here, then spliced in with merge; unload removes a range
+		// again. reserveRange, merge and unload run on the registry's own thread.
+
+		// The reserved indices stay invalid here until the partition is merged
+		EntityRange reserveRange(std::size_t count);
+		// Moves the partition's entities, components and tags into this registry.
+		// Pools this registry lacks are adopted as they are; others absorb the staged
+		// elements in one bulk append. Returns false, changing nothing, if a pool
+		// cannot absorb.
+		bool merge(Partition &partition);
+		// Destroys every entity in range (also a reserved range that was never
+		// merged) and returns the indices to the free list
+		void unload(EntityRange range);
+
+		// Returns the owning group for Ts..., creating it on first use. Returns nullptr
+		// if one of the pools is already owned by another group or has an order.
+		template<typename ...Ts>
+		OwningGroup<Ts...> *group()
+		{
+			auto gid = componentTypeId<OwningGroup<Ts...>>();
+			if (gid < m_groups.size() && m_groups[gid]) return static_cast<OwningGroup<Ts...> *>(m_groups[gid].get());
+			// Checked up front: building the group reorders the pools
+			if (!((pool<Ts>().owner() == nullptr && !pool<Ts>().ordered()) && ...)) return nullptr;
+			auto gp = makeResourcePtr<OwningGroup<Ts...>>(resource(), pool<Ts>()...);
+			(pool<Ts>().setOwner(gp.get()), ...);
+			if (gid >= m_groups.size())
+			{
+				m_groups.resize(gid + 1);
+				m_regroup.resize(gid + 1);
+			}
+			m_groups[gid] = std::move(gp);
+			m_regroup[gid] = [](EntityRegistry &target)
+			{
+				target.group<Ts...>();
+			};
+			return static_cast<OwningGroup<Ts...> *>(m_groups[gid].get());
+		}
+
+		// Shared (flyweight) components
+
+		// Returns nullptr if id is not valid
+		template<typename T, typename Hash = std::hash<T>>
+		const T *setShared(EntityId id, const T &value)
+		{
+			if (!valid(id)) return nullptr;
+			return &sharedPool<T, Hash>().set(id, value);
+		}
+		template<typename T, typename Hash = std::hash<T>>
+		const T *getShared(EntityId id)
+		{
+			auto pp = findPool<SharedPool<T, Hash>>();
+			return pp ? pp->find(id) : nullptr;
+		}
+		template<typename T, typename Hash = std::hash<T>>
+		void removeShared(EntityId id)
+		{
+			if (!valid(id)) return;
+			auto pp = findPool<SharedPool<T, Hash>>();
+			if (pp) pp->remove(id);
+		}
+		template<typename T, typename Hash = std::hash<T>>
+		SharedPool<T, Hash> &sharedPool()
+		{
+			return poolOf<SharedPool<T, Hash>>();
+		}
+
+		// Tag management
+
+		void addTag(EntityId id, const std::string &tag);
+		bool hasTag(EntityId id, const std::string &tag) const;
+		void removeTag(EntityId id, const std::string &tag);
+		const std::vector<std::string> &getTags(EntityId id) const;
+
+		inline std::pmr::memory_resource *resource() const
+		{
+			return m_generation.get_allocator().resource();
+		}
+
+		// Custom storage
+
+		// Any PoolBase-derived storage can live in the registry; it is keyed by its own
+		// type, so a value type can have a plain and a shared pool, and destroy()
+		// removes the entity from it like from any component pool.
+		template<typename PoolT>
+		PoolT &poolOf()
+		{
+			auto tid = componentTypeId<PoolT>();
+			if (tid >= m_pools.size()) m_pools.resize(tid + 1);
+			if (!m_pools[tid])
+			{
+				auto pp = makeResourcePtr<PoolT>(resource());
+				if constexpr (std::is_base_of<BufferedPoolBase, PoolT>::value)
+				{
+					pp->publish(m_frame);
+					m_buffered.push_back(pp.get());
+				}
+				m_pools[tid] = std::move(pp);
+			}
+			return *static_cast<PoolT *>(m_pools[tid].get());
+		}
+
+	private:
+		friend class Journal;
+
+		// Generation of indices reserved for a partition that is not merged yet
+		static constexpr std::uint32_t reservedGeneration = 0xffffffffu;
+
+		struct PagingState;
+
+		// Pages id back in if it is evicted and marks it recently used
+		inline void touch(EntityId id)
+		{
+			if (m_paging) touchPaged(id);
+		}
+		void touchPaged(EntityId id);
+		bool pagedHas(EntityId id, std::size_t tid) const;
+		void pageIn(std::uint32_t index);
+		// Drops paging bookkeeping for an index whose entity is gone
+		void forgetPaged(std::uint32_t index);
+		// Makes exactly id live, whatever the free list would hand out next; used when
+		// replaying a journal
+		void restore(EntityId id);
+
+		template<typename PoolT>
+		PoolT *findPool()
+		{
+			auto tid = componentTypeId<PoolT>();
+			if (tid >= m_pools.size()) return nullptr;
+			return static_cast<PoolT *>(m_pools[tid].get());
+		}
+
+		std::pmr::vector<std::uint32_t> m_generation;
+		std::pmr::vector<std::uint32_t> m_free;
+		std::pmr::vector<std::uint64_t> m_inactive;
+		std::pmr::unordered_map<std::uint32_t, std::vector<std::string>> m_tags;
+		std::pmr::vector<ResourcePtr<PoolBase>> m_pools;
+		std::pmr::vector<ResourcePtr<GroupBase>> m_groups;
+		// Recreates each group in a clone
+		std::pmr::vector<void (*)(EntityRegistry &)> m_regroup;
+		std::pmr::vector<BufferedPoolBase *> m_buffered;
+		std::uint64_t m_frame = 0;
+		std::unique_ptr<PagingState> m_paging;
+		RegistryObserver *m_observer = nullptr;
+		std::size_t m_alive;
+		std::size_t m_compactPool = 0;
+	};
+}
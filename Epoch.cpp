@@ -0,0 +1,110 @@
+#include "Epoch.h"
+#include <thread>
+#include <algorithm>
+#include <iterator>
+
+namespace sde
+{
+	EpochDomain::ReadGuard::ReadGuard(EpochDomain &domain) :
+		m_domain{ domain }, m_slot{ domain.enter() }
+	{}
+
+	EpochDomain::ReadGuard::ReadGuard() :
+		ReadGuard(defaultEpochDomain())
+	{}
+
+	EpochDomain::ReadGuard::~ReadGuard()
+	{
+		m_domain.leave(m_slot);
+	}
+
+	EpochDomain::EpochDomain() :
+		m_epoch{ 1 }
+	{
+		for (auto &slot : m_slots)
+			slot.epoch.store(0, std::memory_order_relaxed);
+	}
+
+	EpochDomain::~EpochDomain()
+	{
+		for (auto &r : m_retired)
+			r.reclaim();
+	}
+
+	std::size_t EpochDomain::enter()
+	{
+		// Start from a per-thread position so readers on different threads rarely collide
+		auto start = std::hash<std::thread::id>{}(std::this_thread::get_id()) % maxReaders;
+		for (;;)
+		{
+			for (std::size_t n = 0; n < maxReaders; ++n)
+			{
+				auto slot = (start + n) % maxReaders;
+				std::uint64_t expected = 0;
+				// An epoch that is stale by the time it lands only delays reclamation
+				if (m_slots[slot].epoch.compare_exchange_strong(expected, m_epoch.load())) return slot;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	void EpochDomain::leave(std::size_t slot)
+	{
+		m_slots[slot].epoch.store(0, std::memory_order_release);
+	}
+
+	void EpochDomain::retire(std::function<void()> reclaim)
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_retired.push_back(Retired{ m_epoch.load(), std::move(reclaim) });
+	}
+
+	std::size_t EpochDomain::collect()
+	{
+		std::vector<Retired> ready;
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			if (m_retired.empty()) return 0;
+			// Readers that start after this point cannot reach anything retired so far
+			m_epoch.fetch_add(1);
+			auto oldest = ~std::uint64_t{ 0 };
+			for (auto &slot : m_slots)
+			{
+				auto e = slot.epoch.load();
+				if (e && e < oldest) oldest = e;
+			}
+			auto keep = std::partition(std::begin(m_retired), std::end(m_retired), [oldest](const Retired &r)
+			{
+				return r.epoch >= oldest;
+			});
+			ready.assign(std::make_move_iterator(keep), std::make_move_iterator(std::end(m_retired)));
+			m_retired.erase(keep, std::end(m_retired));
+		}
+		// Reclaim outside the lock; destructors may retire more
+		for (auto &r : ready)
+			r.reclaim();
+		return ready.size();
+	}
+
+	void EpochDomain::synchronize()
+	{
+		for (;;)
+		{
+			collect();
+			if (pending() == 0) return;
+			std::this_thread::yield();
+		}
+	}
+
+	std::size_t EpochDomain::pending() const
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_retired.size();
+	}
+
+	EpochDomain &defaultEpochDomain()
+	{
+		static EpochDomain domain;
+		return domain;
+	}
+}
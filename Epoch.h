@@ -0,0 +1,162 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace sde
+{
+
+	/* EpochDomain - Epoch-based reclamation. Readers on other threads hold a
+	ReadGuard while they use shared data; the writer unlinks what it replaces and
+	hands it to retire() instead of freeing it. collect() frees whatever was retired
+	before the oldest active reader started, so readers never block the writer and
+	never see freed memory.
+
+	Guards are cheap (one slot claim in a fixed table) and may nest. retire and
+	collect may be called from any thread; reclaim functions run on the thread that
+	calls collect. A reader that never releases its guard stalls reclamation, so
+	guards should cover one frame's worth of reading at most.
+	*/
+
+	class EpochDomain
+	{
+	public:
+		static constexpr std::size_t maxReaders = 64;
+
+		class ReadGuard
+		{
+		public:
+			explicit ReadGuard(EpochDomain &domain);
+			ReadGuard();
+			~ReadGuard();
+			ReadGuard(const ReadGuard &other) = delete;
+			ReadGuard &operator=(const ReadGuard &other) = delete;
+		private:
+			EpochDomain &m_domain;
+			std::size_t m_slot;
+		};
+
+		EpochDomain();
+		// Reclaims everything still pending; no reader may be active
+		~EpochDomain();
+		EpochDomain(const EpochDomain &other) = delete;
+		EpochDomain &operator=(const EpochDomain &other) = delete;
+
+		// Runs reclaim once every reader active now has released its guard
+		void retire(std::function<void()> reclaim);
+		template<typename T>
+		void retire(T *p)
+		{
+			retire([p]
+			{
+				delete p;
+			});
+		}
+		// Advances the epoch and runs every reclaim function that is now safe;
+		// returns the number run
+		std::size_t collect();
+		// Blocks until everything retired so far has been reclaimed
+		void synchronize();
+		std::size_t pending() const;
+
+	private:
+		struct alignas(64) Slot
+		{
+			// Epoch announced by the reader holding the slot, 0 when free
+			std::atomic<std::uint64_t> epoch;
+		};
+		struct Retired
+		{
+			std::uint64_t epoch;
+			std::function<void()> reclaim;
+		};
+
+		std::size_t enter();
+		void leave(std::size_t slot);
+
+		Slot m_slots[maxReaders];
+		std::atomic<std::uint64_t> m_epoch;
+		mutable std::mutex m_mutex;
+		std::vector<Retired> m_retired;
+	};
+
+	// Domain used by AutoList and the event receiver snapshots
+	EpochDomain &defaultEpochDomain();
+
+	/* Published - RCU cell: the writer replaces the whole value with publish(),
+	readers load it with get() under a ReadGuard on the same domain and keep using
+	it for as long as the guard lives.
+	*/
+
+	template<typename T>
+	class Published
+	{
+	public:
+		Published() :
+			m_ptr{ nullptr }
+		{}
+		~Published()
+		{
+			delete m_ptr.load();
+		}
+		Published(const Published &other) = delete;
+		Published &operator=(const Published &other) = delete;
+
+		inline const T *get() const
+		{
+			return m_ptr.load();
+		}
+		void publish(std::unique_ptr<const T> value, EpochDomain &domain)
+		{
+			auto prev = m_ptr.exchange(value.release());
+			if (prev) domain.retire(prev);
+		}
+	private:
+		std::atomic<const T *> m_ptr;
+	};
+
+	/* EpochResource - Memory resource adapter whose deallocations are retired to an
+	EpochDomain rather than returned upstream at once. Giving it to an
+	EntityRegistry makes pool storage safe to read under a ReadGuard while the
+	writer grows, shrinks or compacts pools: an array a reader is still looking at
+	survives until the reader leaves. Readers see memory that stays valid, not a
+	consistent snapshot of the values in it.
+	*/
+
+	class EpochResource : public std::pmr::memory_resource
+	{
+	public:
+		explicit EpochResource(EpochDomain &domain = defaultEpochDomain(),
+			std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) :
+			m_domain{ domain }, m_upstream{ upstream }
+		{}
+
+	protected:
+		void *do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			return m_upstream->allocate(bytes, alignment);
+		}
+		void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+		{
+			auto upstream = m_upstream;
+			m_domain.retire([upstream, p, bytes, alignment]
+			{
+				upstream->deallocate(p, bytes, alignment);
+			});
+		}
+		bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+		{
+			return this == &other;
+		}
+
+	private:
+		EpochDomain &m_domain;
+		std::pmr::memory_resource *m_upstream;
+	};
+}
@@ -5,20 +5,61 @@ namespace sde
 {
 
 	std::map<std::type_index, std::vector<EventHandler *>> EventHandler::m_receiverMap;
+	Published<std::map<std::type_index, std::vector<EventHandler *>>> EventHandler::m_publishedReceivers;
 
 	EventHandler::~EventHandler()
 	{
-		for (auto &p : m_receiverMap)
+		unregisterReceivers();
+	}
+
+	void EventHandler::unregisterReceivers()
+	{
+		if (!m_events) return;
+		for (auto &e : m_events->funcMap)
 		{
-			auto rp = std::find(begin(p.second), end(p.second), this);
-			if (rp != end(p.second)) p.second.erase(rp);
+			auto p = m_receiverMap.find(e.first);
+			if (p == end(m_receiverMap)) continue;
+			auto rp = std::find(begin(p->second), end(p->second), this);
+			if (rp != end(p->second)) p->second.erase(rp);
 		}
 	}
 
 	void EventHandler::handleEvent(EventBase *evnt)
 	{
-		auto p = m_funcMap.find(std::type_index{ typeid(*evnt) });
-		if (p != end(m_funcMap)) p->second->call(evnt);
+		if (!m_events) return;
+		std::type_index ti{ typeid(*evnt) };
+		for (auto &e : m_events->funcMap)
+		{
+			if (e.first == ti)
+			{
+				e.second->call(evnt);
+				return;
+			}
+		}
+	}
+
+	void EventHandler::reserveEvents(std::size_t n, std::pmr::memory_resource *resource)
+	{
+		if (!m_events) createEventState(resource);
+		m_events->funcMap.reserve(n);
+	}
+
+	void EventHandler::createEventState(std::pmr::memory_resource *resource)
+	{
+		auto mem = resource->allocate(sizeof(EventState), alignof(EventState));
+		m_events.reset(new (mem) EventState{ std::pmr::vector<FuncEntry>{ resource } });
+	}
+
+	void EventHandler::EventStateDeleter::operator()(EventState *state) const
+	{
+		auto resource = state->funcMap.get_allocator().resource();
+		state->~EventState();
+		resource->deallocate(state, sizeof(EventState), alignof(EventState));
+	}
+
+	void EventHandler::publishReceivers(EpochDomain &domain)
+	{
+		m_publishedReceivers.publish(std::make_unique<const std::map<std::type_index, std::vector<EventHandler *>>>(m_receiverMap), domain);
 	}
 
 	void EventHandler::broadcast(EventBase *evnt)
@@ -0,0 +1,267 @@
+#pragma once
+#include "EntityRegistry.h"
+
+namespace sde
+{
+
+	/* HierarchyPool - Parent/child relationships for registry entities, with world
+	transforms propagated in one linear pass. Nodes are kept in breadth-first order
+	(sorted by depth), so every parent is visited before its children and no
+	recursion or pointer chasing is needed. Only nodes whose local transform changed,
+	or whose parent's world transform changed this pass, are recomputed.
+
+	TransformT must be copyable and provide parentWorld * local composition.
+	Attach with registry.poolOf<HierarchyPool<TransformT>>(). Destroying a parent
+	turns its children into roots.
+	*/
+
+	template<typename TransformT>
+	class HierarchyPool : public PoolBase
+	{
+	public:
+		explicit HierarchyPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			PoolBase{ resource }, m_parent{ resource }, m_parentSlot{ resource }, m_local{ resource },
+			m_world{ resource }, m_dirty{ resource }, m_moved{ resource }, m_orderDirty{ false }
+		{}
+
+		void add(EntityId id, const TransformT &local, EntityId parent = nullEntity)
+		{
+			if (findSlot(id) == SparseIndex::npos)
+			{
+				addEntity(id);
+				m_parent.push_back(nullEntity);
+				m_parentSlot.push_back(SparseIndex::npos);
+				m_local.push_back(local);
+				m_world.push_back(local);
+				m_dirty.push_back(1);
+			}
+			else setLocal(id, local);
+			setParent(id, parent);
+		}
+		void remove(EntityId id) override
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			auto last = eraseSlot(slot);
+			// Parent slots are recomputed by the re-sort this forces
+			eraseFromColumns(slot, last, m_parent, m_parentSlot, m_local, m_world, m_dirty);
+			m_orderDirty = true;
+		}
+
+		// Returns false if either entity is not in the hierarchy or the link would form a cycle
+		bool setParent(EntityId id, EntityId parent)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return false;
+			if (parent != nullEntity)
+			{
+				if (findSlot(parent) == SparseIndex::npos) return false;
+				// An ancestor removed since the last propagate() ends the chain; it is a
+				// root from then on
+				for (auto p = parent; p != nullEntity; )
+				{
+					if (p == id) return false;
+					auto ps = findSlot(p);
+					if (ps == SparseIndex::npos) break;
+					p = m_parent[ps];
+				}
+			}
+			m_parent[slot] = parent;
+			m_dirty[slot] = 1;
+			m_orderDirty = true;
+			return true;
+		}
+		inline EntityId parent(EntityId id) const
+		{
+			auto slot = findSlot(id);
+			return slot == SparseIndex::npos ? nullEntity : m_parent[slot];
+		}
+
+		void setLocal(EntityId id, const TransformT &local)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			m_local[slot] = local;
+			m_dirty[slot] = 1;
+		}
+		inline const TransformT *local(EntityId id) const
+		{
+			auto slot = findSlot(id);
+			return slot == SparseIndex::npos ? nullptr : &m_local[slot];
+		}
+		// World transform as of the last propagate()
+		inline const TransformT *world(EntityId id) const
+		{
+			auto slot = findSlot(id);
+			return slot == SparseIndex::npos ? nullptr : &m_world[slot];
+		}
+
+		void propagate()
+		{
+			if (m_orderDirty) sortByDepth();
+			for (std::size_t i = 0; i < m_entities.size(); ++i)
+			{
+				auto p = m_parentSlot[i];
+				if (p != SparseIndex::npos && m_dirty[p])
+					m_dirty[i] = 1;
+				if (!m_dirty[i]) continue;
+				if (p == SparseIndex::npos) m_world[i] = m_local[i];
+				else m_world[i] = m_world[p] * m_local[i];
+			}
+			// Parents precede children, so flags can only be cleared once the pass is done
+			std::fill(std::begin(m_dirty), std::end(m_dirty), std::uint8_t{ 0 });
+		}
+
+		void reserve(std::size_t count, std::size_t indexBound) override
+		{
+			PoolBase::reserve(count, indexBound);
+			m_parent.reserve(count);
+			m_parentSlot.reserve(count);
+			m_local.reserve(count);
+			m_world.reserve(count);
+			m_dirty.reserve(count);
+			m_moved.reserve(count);
+		}
+		void prefault() override
+		{
+			PoolBase::prefault();
+			touchCapacity(m_parent);
+			touchCapacity(m_parentSlot);
+			touchCapacity(m_local);
+			touchCapacity(m_world);
+			touchCapacity(m_dirty);
+			touchCapacity(m_moved);
+		}
+		void memoryRanges(std::vector<MemoryRange> &out) const override
+		{
+			PoolBase::memoryRanges(out);
+			addMemoryRange(out, m_parent);
+			addMemoryRange(out, m_parentSlot);
+			addMemoryRange(out, m_local);
+			addMemoryRange(out, m_world);
+			addMemoryRange(out, m_dirty);
+			addMemoryRange(out, m_moved);
+		}
+
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override
+		{
+			auto pp = makeResourcePtr<HierarchyPool>(resource);
+			pp->copyBase(*this);
+			pp->m_parent = m_parent;
+			pp->m_parentSlot = m_parentSlot;
+			pp->m_local = m_local;
+			pp->m_world = m_world;
+			pp->m_dirty = m_dirty;
+			pp->m_orderDirty = m_orderDirty;
+			return pp;
+		}
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		void absorb(PoolBase &other) override
+		{
+			auto &src = static_cast<HierarchyPool &>(other);
+			appendEntities(src);
+			m_parent.insert(std::end(m_parent), std::begin(src.m_parent), std::end(src.m_parent));
+			m_parentSlot.resize(m_entities.size(), SparseIndex::npos);
+			m_local.insert(std::end(m_local), std::begin(src.m_local), std::end(src.m_local));
+			m_world.insert(std::end(m_world), std::begin(src.m_world), std::end(src.m_world));
+			m_dirty.resize(m_entities.size(), 1);
+			m_orderDirty = true;
+		}
+
+	private:
+		// Recomputes depths and reorders all nodes breadth-first with a counting sort
+		void sortByDepth()
+		{
+			static constexpr std::uint32_t unknown = 0xffffffffu;
+			auto count = m_entities.size();
+			std::vector<std::uint32_t> depth(count, unknown);
+			std::vector<std::uint32_t> chain;
+			std::uint32_t maxDepth = 0;
+
+			for (std::uint32_t i = 0; i < count; ++i)
+			{
+				// Walk up until a node of known depth or a root, then unwind
+				auto s = i;
+				while (depth[s] == unknown)
+				{
+					chain.push_back(s);
+					auto p = m_parent[s] == nullEntity ? SparseIndex::npos : findSlot(m_parent[s]);
+					if (p == SparseIndex::npos)
+					{
+						// Orphaned by a removed parent
+						if (m_parent[s] != nullEntity)
+						{
+							m_parent[s] = nullEntity;
+							m_dirty[s] = 1;
+						}
+						depth[s] = 0;
+						chain.pop_back();
+						break;
+					}
+					s = p;
+				}
+				auto d = depth[s];
+				while (!chain.empty())
+				{
+					depth[chain.back()] = ++d;
+					chain.pop_back();
+				}
+				maxDepth = std::max(maxDepth, depth[i]);
+			}
+
+			std::vector<std::uint32_t> start(maxDepth + 2, 0);
+			for (auto d : depth)
+				++start[d + 1];
+			for (std::size_t d = 1; d < start.size(); ++d)
+				start[d] += start[d - 1];
+			std::vector<std::uint32_t> order(count);
+			for (std::uint32_t i = 0; i < count; ++i)
+				order[start[depth[i]]++] = i;
+
+			permute(m_entities, order, m_moved);
+			permute(m_parent, order, m_moved);
+			permute(m_local, order, m_moved);
+			permute(m_world, order, m_moved);
+			permute(m_dirty, order, m_moved);
+			for (std::uint32_t i = 0; i < count; ++i)
+				m_sparse.set(m_entities[i].index, i);
+			for (std::uint32_t i = 0; i < count; ++i)
+				m_parentSlot[i] = m_parent[i] == nullEntity ? SparseIndex::npos : findSlot(m_parent[i]);
+			m_orderDirty = false;
+		}
+		// Element i becomes v[order[i]]. Works in place, one cycle of the permutation
+		// at a time, so the columns keep their reserved (and locked) buffers.
+		template<typename V>
+		static void permute(V &v, const std::vector<std::uint32_t> &order, std::pmr::vector<std::uint8_t> &moved)
+		{
+			moved.assign(order.size(), 0);
+			for (std::size_t i = 0; i < order.size(); ++i)
+			{
+				if (moved[i]) continue;
+				auto first = std::move(v[i]);
+				auto j = i;
+				while (order[j] != i)
+				{
+					v[j] = std::move(v[order[j]]);
+					moved[j] = 1;
+					j = order[j];
+				}
+				v[j] = std::move(first);
+				moved[j] = 1;
+			}
+		}
+
+		std::pmr::vector<EntityId> m_parent;
+		// Dense slot of each node's parent, valid while the order is clean
+		std::pmr::vector<std::uint32_t> m_parentSlot;
+		std::pmr::vector<TransformT> m_local;
+		std::pmr::vector<TransformT> m_world;
+		std::pmr::vector<std::uint8_t> m_dirty;
+		// Scratch for permute
+		std::pmr::vector<std::uint8_t> m_moved;
+		bool m_orderDirty;
+	};
+}
@@ -0,0 +1,181 @@
+#include "HugePageResource.h"
+#include <new>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#define SDE_HAS_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace sde
+{
+	namespace
+	{
+#if defined(SDE_HAS_MMAP)
+		std::size_t systemPageSize()
+		{
+			static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+			return size;
+		}
+
+		// Maps size bytes at an address aligned to alignment by over-mapping and
+		// trimming both ends
+		void *mapAligned(std::size_t size, std::size_t alignment)
+		{
+			auto span = size + (alignment > systemPageSize() ? alignment : 0);
+			auto p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED) return nullptr;
+			auto base = reinterpret_cast<std::uintptr_t>(p);
+			auto aligned = (base + alignment - 1) / alignment * alignment;
+			if (aligned != base) munmap(p, aligned - base);
+			auto tail = base + span - (aligned + size);
+			if (tail) munmap(reinterpret_cast<void *>(aligned + size), tail);
+			return reinterpret_cast<void *>(aligned);
+		}
+#endif
+	}
+
+	HugePageResource::HugePageResource(int numaNode, std::size_t hugeThreshold) :
+		m_numaNode{ numaNode }, m_hugeThreshold{ hugeThreshold }, m_hugetlb{ 0 }, m_transparentAdvised{ 0 },
+		m_normal{ 0 }, m_numaBound{ 0 }, m_numaFailed{ 0 }, m_mapped{ 0 }
+	{}
+
+	HugePageStats HugePageResource::stats() const
+	{
+		return HugePageStats{ m_hugetlb.load(), m_transparentAdvised.load(), m_normal.load(),
+			m_numaBound.load(), m_numaFailed.load(), m_mapped.load() };
+	}
+
+	std::size_t HugePageResource::mappingSize(std::size_t bytes, std::size_t alignment) const
+	{
+#if defined(SDE_HAS_MMAP)
+		auto granule = bytes >= m_hugeThreshold ? hugePageSize : systemPageSize();
+		if (alignment > granule) granule = alignment;
+		return (bytes + granule - 1) / granule * granule;
+#else
+		(void)alignment;
+		return bytes;
+#endif
+	}
+
+	void *HugePageResource::do_allocate(std::size_t bytes, std::size_t alignment)
+	{
+		if (bytes == 0) bytes = 1;
+		auto size = mappingSize(bytes, alignment);
+#if defined(SDE_HAS_MMAP)
+		void *p = nullptr;
+		if (bytes >= m_hugeThreshold)
+		{
+#if defined(__linux__) && defined(MAP_HUGETLB)
+			if (alignment <= hugePageSize)
+			{
+				auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+				flags |= 21 << MAP_HUGE_SHIFT;
+#endif
+				p = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+				if (p == MAP_FAILED) p = nullptr;
+				else m_hugetlb += size;
+			}
+#endif
+			if (!p)
+			{
+				p = mapAligned(size, alignment > hugePageSize ? alignment : hugePageSize);
+				if (!p) throw std::bad_alloc{};
+#if defined(MADV_HUGEPAGE)
+				if (madvise(p, size, MADV_HUGEPAGE) == 0) m_transparentAdvised += size;
+				else m_normal += size;
+#else
+				m_normal += size;
+#endif
+			}
+		}
+		else
+		{
+			p = mapAligned(size, alignment);
+			if (!p) throw std::bad_alloc{};
+			m_normal += size;
+		}
+		if (m_numaNode >= 0) bindToNode(p, size);
+		m_mapped += size;
+		return p;
+#else
+		auto p = std::pmr::new_delete_resource()->allocate(size, alignment);
+		m_normal += size;
+		m_mapped += size;
+		return p;
+#endif
+	}
+
+	void HugePageResource::do_deallocate(void *p, std::size_t bytes, std::size_t alignment)
+	{
+		if (bytes == 0) bytes = 1;
+		auto size = mappingSize(bytes, alignment);
+#if defined(SDE_HAS_MMAP)
+		munmap(p, size);
+#else
+		std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+#endif
+		m_mapped -= size;
+	}
+
+	bool HugePageResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+	{
+		return this == &other;
+	}
+
+	void HugePageResource::bindToNode(void *p, std::size_t size)
+	{
+#if defined(__linux__) && defined(SYS_mbind)
+		// MPOL_BIND from <numaif.h>, spelled out to avoid depending on libnuma
+		constexpr int mpolBind = 2;
+		constexpr std::size_t maskBits = 1024;
+		unsigned long mask[maskBits / (8 * sizeof(unsigned long))] = {};
+		auto node = static_cast<std::size_t>(m_numaNode);
+		if (node < maskBits - 1)
+		{
+			mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+			if (syscall(SYS_mbind, p, size, mpolBind, mask, maskBits, 0) == 0)
+			{
+				m_numaBound += size;
+				return;
+			}
+		}
+#else
+		(void)p;
+#endif
+		m_numaFailed += size;
+	}
+
+	int currentNumaNode()
+	{
+#if defined(__linux__) && defined(SYS_getcpu)
+		unsigned cpu = 0, node = 0;
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return static_cast<int>(node);
+#endif
+		return -1;
+	}
+
+	std::size_t transparentHugePageBytes()
+	{
+		std::size_t total = 0;
+#if defined(__linux__)
+		auto file = std::fopen("/proc/self/smaps_rollup", "r");
+		if (!file) return 0;
+		char line[256];
+		while (std::fgets(line, sizeof(line), file))
+		{
+			unsigned long long kb = 0;
+			if (std::strncmp(line, "AnonHugePages:", 14) == 0 && std::sscanf(line + 14, "%llu", &kb) == 1)
+				total += static_cast<std::size_t>(kb) * 1024;
+		}
+		std::fclose(file);
+#endif
+		return total;
+	}
+}
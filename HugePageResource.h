@@ -0,0 +1,94 @@
+#pragma once
+#include <memory_resource>
+#include <atomic>
+#include <cstddef>
+
+namespace sde
+{
+
+	/* HugePageStats - Bytes mapped per kind of backing since the resource was
+	created. hugetlb is explicit 2 MB pages (MAP_HUGETLB); transparentAdvised is
+	memory the kernel accepted a MADV_HUGEPAGE hint for, which says nothing about
+	how much of it it actually backs with huge pages (see
+	transparentHugePageBytes); normal is everything else. numaBound and numaFailed
+	count the bytes a node binding was requested for, by outcome.
+	*/
+
+	struct HugePageStats
+	{
+		std::size_t hugetlb;
+		std::size_t transparentAdvised;
+		std::size_t normal;
+		std::size_t numaBound;
+		std::size_t numaFailed;
+		std::size_t mapped;
+	};
+
+	/* HugePageResource - Memory resource that maps its blocks straight from the
+	OS. Requests of at least hugeThreshold bytes are rounded up to whole 2 MB pages
+	and backed by explicit huge pages if the system has them reserved, otherwise by
+	2 MB-aligned memory advised for transparent huge pages, otherwise by normal
+	pages. With numaNode >= 0, each mapping is bound to that node before it is first
+	touched.
+
+	Every request is its own mapping, so use it as the upstream of a pool, e.g.
+
+		HugePageResource huge{ currentNumaNode() };
+		std::pmr::unsynchronized_pool_resource pool{ &huge };
+		EntityRegistry registry{ &pool };
+
+	so that large pool arrays get huge pages and small tables share chunks. Safe to
+	use from several threads. Where mmap is unavailable, blocks come from the
+	default heap and are reported as normal.
+	*/
+
+	class HugePageResource : public std::pmr::memory_resource
+	{
+	public:
+		static constexpr std::size_t hugePageSize = std::size_t{ 2 } << 20;
+
+		explicit HugePageResource(int numaNode = -1, std::size_t hugeThreshold = hugePageSize / 2);
+		HugePageResource(const HugePageResource &other) = delete;
+		HugePageResource &operator=(const HugePageResource &other) = delete;
+
+		HugePageStats stats() const;
+		inline int numaNode() const
+		{
+			return m_numaNode;
+		}
+
+	protected:
+		void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+		void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+	private:
+		std::size_t mappingSize(std::size_t bytes, std::size_t alignment) const;
+		void bindToNode(void *p, std::size_t size);
+
+		int m_numaNode;
+		std::size_t m_hugeThreshold;
+		std::atomic<std::size_t> m_hugetlb;
+		std::atomic<std::size_t> m_transparentAdvised;
+		std::atomic<std::size_t> m_normal;
+		std::atomic<std::size_t> m_numaBound;
+		std::atomic<std::size_t> m_numaFailed;
+		std::atomic<std::size_t> m_mapped;
+	};
+
+	/* currentNumaNode - NUMA node of the CPU the calling thread is running on, or -1
+	if it cannot be determined. Call it from a thread that runs the world's systems
+	(pinned, ideally) to pick the node for that world's HugePageResource.
+	*/
+
+	int currentNumaNode();
+
+	/* transparentHugePageBytes - Anonymous memory of the whole process currently
+	backed by transparent huge pages (AnonHugePages in /proc/self/smaps_rollup), or
+	0 where that is not available. Compare it with
+	HugePageStats::transparentAdvised to see how much of the advice the kernel
+	followed.
+	*/
+
+	std::size_t transparentHugePageBytes();
+}
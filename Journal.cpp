@@ -0,0 +1,617 @@
+#include "Journal.h"
+#include <random>
+
+namespace sde
+{
+	namespace
+	{
+		constexpr std::uint32_t journalMagic = 0x4a454453; // "SDEJ"
+		constexpr std::uint32_t snapshotMagic = 0x53454453; // "SDES"
+		constexpr std::uint32_t formatVersion = 2;
+
+		enum Op : std::uint8_t
+		{
+			opCreate,
+			opDestroy,
+			opActive,
+			opSet,
+			opRemove,
+			opTagAdd,
+			opTagRemove
+		};
+
+		std::uint32_t checksum(const unsigned char *data, std::size_t size)
+		{
+			std::uint32_t h = 2166136261u;
+			for (std::size_t i = 0; i < size; ++i)
+				h = (h ^ data[i]) * 16777619u;
+			return h;
+		}
+
+		template<typename T>
+		bool readValue(std::FILE *file, T &value)
+		{
+			return std::fread(&value, sizeof(T), 1, file) == 1;
+		}
+
+		// Bounds-checked reader over a journal block
+		struct Cursor
+		{
+			const unsigned char *p;
+			const unsigned char *end;
+
+			template<typename T>
+			bool read(T &value)
+			{
+				if (end - p < static_cast<std::ptrdiff_t>(sizeof(T))) return false;
+				std::memcpy(&value, p, sizeof(T));
+				p += sizeof(T);
+				return true;
+			}
+			const unsigned char *take(std::size_t size)
+			{
+				if (static_cast<std::size_t>(end - p) < size) return nullptr;
+				auto q = p;
+				p += size;
+				return q;
+			}
+		};
+	}
+
+	Journal::Journal(EntityRegistry &registry, const std::string &snapshotPath, const std::string &journalPath) :
+		m_registry(registry), m_snapshotPath{ snapshotPath }, m_journalPath{ journalPath }, m_sequence{ 0 },
+		m_records{ 0 }, m_submitted{ 0 }, m_done{ 0 }, m_stop{ false }, m_file{ nullptr },
+		m_blocksWritten{ 0 }, m_rawBytes{ 0 }, m_bytesWritten{ 0 }, m_failed{ false }, m_compress{ false }
+	{
+		m_block.reserve(blockSize);
+	}
+
+	Journal::~Journal()
+	{
+		if (m_registry.observer() == this) m_registry.setObserver(nullptr);
+		if (m_file) sync();
+		stopWriter();
+	}
+
+	std::uint64_t Journal::nameKey(const std::string &name)
+	{
+		std::uint64_t h = 14695981039346656037ull;
+		for (auto c : name)
+			h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		return h;
+	}
+
+	void Journal::addType(const TypeInfo &info)
+	{
+		if (info.tid >= m_byTid.size()) m_byTid.resize(info.tid + 1, -1);
+		if (m_byTid[info.tid] >= 0) return;
+		m_byTid[info.tid] = static_cast<int>(m_types.size());
+		m_types.push_back(info);
+	}
+
+	const Journal::TypeInfo *Journal::typeOf(std::uint64_t key) const
+	{
+		for (auto &t : m_types)
+		{
+			if (t.key == key) return &t;
+		}
+		return nullptr;
+	}
+
+	// Recovery
+
+	bool Journal::recover()
+	{
+		if (m_registry.m_alive || !m_registry.m_generation.empty()) return false;
+		auto file = std::fopen(m_snapshotPath.c_str(), "rb");
+		if (!file) return true;
+
+		// Read every section, decode all their frames at once, then apply
+		std::uint32_t magic, version, count, typeCount;
+		std::vector<Section> sections(1);
+		bool ok = readValue(file, magic) && magic == snapshotMagic && readValue(file, version) &&
+			version == formatVersion && readValue(file, m_sequence) && readValue(file, count) &&
+			readSection(file, sections[0]) && readValue(file, typeCount);
+		struct Column
+		{
+			const TypeInfo *type;
+			std::uint32_t size;
+			std::uint32_t count;
+		};
+		std::vector<Column> columns;
+		for (std::uint32_t i = 0; ok && i < typeCount; ++i)
+		{
+			std::uint64_t key;
+			Column c;
+			sections.emplace_back();
+			ok = readValue(file, key) && readValue(file, c.size) && readValue(file, c.count) && readSection(file, sections.back()) &&
+				sections.back().raw.size() == std::size_t{ c.count } * (sizeof(std::uint32_t) + c.size);
+			c.type = typeOf(key);
+			if (c.type && c.type->size != c.size) c.type = nullptr;
+			columns.push_back(c);
+		}
+		std::fclose(file);
+		if (!ok || !decodeSections(sections)) return false;
+
+		Cursor in{ sections[0].raw.data(), sections[0].raw.data() + sections[0].raw.size() };
+		std::vector<EntityId> inactive;
+		std::string tag;
+		for (std::uint32_t i = 0; ok && i < count; ++i)
+		{
+			EntityId id;
+			std::uint8_t isActive;
+			std::uint32_t tagCount;
+			ok = in.read(id.index) && in.read(id.generation) && in.read(isActive) && in.read(tagCount);
+			if (!ok) break;
+			m_registry.restore(id);
+			if (!isActive) inactive.push_back(id);
+			for (std::uint32_t t = 0; ok && t < tagCount; ++t)
+			{
+				std::uint32_t length;
+				const unsigned char *chars = nullptr;
+				ok = in.read(length) && (chars = in.take(length));
+				if (!ok) break;
+				tag.assign(reinterpret_cast<const char *>(chars), length);
+				m_registry.addTag(id, tag);
+			}
+		}
+		for (std::size_t i = 0; ok && i < columns.size(); ++i)
+		{
+			if (!columns[i].type) continue;
+			auto record = sections[i + 1].raw.data();
+			for (std::uint32_t c = 0; ok && c < columns[i].count; ++c, record += sizeof(std::uint32_t) + columns[i].size)
+			{
+				std::uint32_t index;
+				std::memcpy(&index, record, sizeof(index));
+				ok = index < m_registry.m_generation.size();
+				if (ok) columns[i].type->set(m_registry, EntityId{ index, m_registry.m_generation[index] }, record + sizeof(index));
+			}
+		}
+		if (!ok) return false;
+		for (auto id : inactive)
+			m_registry.setActive(id, false);
+
+		// A journal belongs to the snapshot whose sequence it carries; one left over
+		// from before the snapshot was replaced is stale
+		file = std::fopen(m_journalPath.c_str(), "rb");
+		if (!file) return true;
+		std::uint64_t base;
+		Section blocks;
+		if (readValue(file, magic) && magic == journalMagic && readValue(file, version) &&
+			version == formatVersion && readValue(file, base) && base == m_sequence)
+		{
+			std::uint32_t sum;
+			while (readValue(file, sum))
+			{
+				auto frame = blocks.stored.size();
+				if (!readFrame(file, blocks)) break;
+				if (checksum(blocks.stored.data() + frame, blocks.stored.size() - frame) != sum)
+				{
+					blocks.frames.pop_back();
+					break;
+				}
+			}
+		}
+		std::fclose(file);
+		std::vector<Section> journal(1);
+		journal[0] = std::move(blocks);
+		// Replay everything up to the first torn or corrupt block
+		if (!decodeSections(journal)) return true;
+		auto raw = journal[0].raw.data();
+		for (auto &f : journal[0].frames)
+		{
+			replay(raw, f.rawSize);
+			raw += f.rawSize;
+		}
+		return true;
+	}
+
+	bool Journal::readFrame(std::FILE *file, Section &section)
+	{
+		unsigned char header[frameHeaderSize];
+		if (std::fread(header, 1, frameHeaderSize, file) != frameHeaderSize) return false;
+		FrameHeader h;
+		std::uint32_t stored;
+		std::memcpy(&stored, header + 9, sizeof(stored));
+		if (!readFrameHeader(header, frameHeaderSize + std::size_t{ stored }, h) || h.storedSize > compressBound(h.rawSize)) return false;
+		auto offset = section.stored.size();
+		section.stored.resize(offset + frameHeaderSize + h.storedSize);
+		std::memcpy(section.stored.data() + offset, header, frameHeaderSize);
+		if (std::fread(section.stored.data() + offset + frameHeaderSize, 1, h.storedSize, file) != h.storedSize)
+		{
+			section.stored.resize(offset);
+			return false;
+		}
+		section.frames.push_back(Frame{ offset, h.rawSize });
+		return true;
+	}
+
+	bool Journal::readSection(std::FILE *file, Section &section)
+	{
+		std::uint64_t rawSize;
+		std::uint32_t frameCount;
+		if (!readValue(file, rawSize) || !readValue(file, frameCount)) return false;
+		std::uint64_t total = 0;
+		for (std::uint32_t i = 0; i < frameCount; ++i)
+		{
+			if (!readFrame(file, section)) return false;
+			total += section.frames.back().rawSize;
+		}
+		if (total != rawSize) return false;
+		section.raw.resize(rawSize);
+		return true;
+	}
+
+	bool Journal::decodeSections(std::vector<Section> &sections)
+	{
+		std::vector<FrameJob> jobs;
+		for (auto &s : sections)
+		{
+			std::size_t total = 0;
+			for (auto &f : s.frames)
+				total += f.rawSize;
+			s.raw.resize(total);
+			auto out = s.raw.data();
+			for (auto &f : s.frames)
+			{
+				jobs.push_back(FrameJob{ s.stored.data() + f.offset, out });
+				out += f.rawSize;
+			}
+		}
+		return decodeFrames(jobs);
+	}
+
+	void Journal::replay(const unsigned char *data, std::size_t size)
+	{
+		Cursor in{ data, data + size };
+		std::string tag;
+		std::uint8_t op;
+		while (in.read(op))
+		{
+			EntityId id;
+			if (!in.read(id.index) || !in.read(id.generation)) return;
+			switch (op)
+			{
+			case opCreate:
+				m_registry.restore(id);
+				break;
+			case opDestroy:
+				m_registry.destroy(id);
+				break;
+			case opActive:
+			{
+				std::uint8_t b;
+				if (!in.read(b)) return;
+				if (m_registry.valid(id)) m_registry.setActive(id, b != 0);
+				break;
+			}
+			case opSet:
+			{
+				std::uint64_t key;
+				std::uint32_t length;
+				if (!in.read(key) || !in.read(length)) return;
+				auto value = in.take(length);
+				if (!value) return;
+				auto tp = typeOf(key);
+				if (tp && tp->size == length && m_registry.valid(id)) tp->set(m_registry, id, value);
+				break;
+			}
+			case opRemove:
+			{
+				std::uint64_t key;
+				if (!in.read(key)) return;
+				auto tp = typeOf(key);
+				if (tp) tp->remove(m_registry, id);
+				break;
+			}
+			case opTagAdd:
+			case opTagRemove:
+			{
+				std::uint32_t length;
+				if (!in.read(length)) return;
+				auto chars = in.take(length);
+				if (!chars) return;
+				tag.assign(reinterpret_cast<const char *>(chars), length);
+				if (!m_registry.valid(id)) break;
+				if (op == opTagAdd) m_registry.addTag(id, tag);
+				else m_registry.removeTag(id, tag);
+				break;
+			}
+			default:
+				return;
+			}
+		}
+	}
+
+	// Snapshots
+
+	bool Journal::snapshot()
+	{
+		if (m_registry.pagingStats().evicted) return false;
+		if (m_file) sync();
+		std::random_device rd;
+		auto sequence = (std::uint64_t{ rd() } << 32) | rd();
+		auto tmpPath = m_snapshotPath + ".tmp";
+		if (!writeSnapshot(tmpPath, sequence) || std::rename(tmpPath.c_str(), m_snapshotPath.c_str()) != 0)
+		{
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+		m_sequence = sequence;
+		// The writer is idle after sync, so the file can be swapped under the lock
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		if (m_file) std::fclose(m_file);
+		m_file = std::fopen(m_journalPath.c_str(), "wb");
+		bool ok = m_file && std::fwrite(&journalMagic, sizeof(journalMagic), 1, m_file) == 1 &&
+			std::fwrite(&formatVersion, sizeof(formatVersion), 1, m_file) == 1 &&
+			std::fwrite(&m_sequence, sizeof(m_sequence), 1, m_file) == 1 && std::fflush(m_file) == 0;
+		if (!ok)
+		{
+			// Nothing recorded from here on could be written, so stop recording
+			if (m_file) std::fclose(m_file);
+			m_file = nullptr;
+			m_failed = true;
+			lock.unlock();
+			if (m_registry.observer() == this) m_registry.setObserver(nullptr);
+			stopWriter();
+			m_block.clear();
+			return false;
+		}
+		m_failed = false;
+		if (!m_writer.joinable())
+		{
+			m_stop = false;
+			m_writer = std::thread{ [this] { writerLoop(); } };
+		}
+		m_registry.setObserver(this);
+		return true;
+	}
+
+	bool Journal::writeSnapshot(const std::string &path, std::uint64_t sequence)
+	{
+		auto file = std::fopen(path.c_str(), "wb");
+		if (!file) return false;
+		auto &generation = m_registry.m_generation;
+		std::fwrite(&snapshotMagic, sizeof(snapshotMagic), 1, file);
+		std::fwrite(&formatVersion, sizeof(formatVersion), 1, file);
+		std::fwrite(&sequence, sizeof(sequence), 1, file);
+		auto count = static_cast<std::uint32_t>(m_registry.size());
+		std::fwrite(&count, sizeof(count), 1, file);
+		std::vector<bool> dead(generation.size());
+		for (auto index : m_registry.m_free)
+			dead[index] = true;
+		std::vector<unsigned char> raw;
+		auto put = [&raw](const void *data, std::size_t size)
+		{
+			auto p = static_cast<const unsigned char *>(data);
+			raw.insert(std::end(raw), p, p + size);
+		};
+		// Indices reserved for unmerged partitions are not valid and are left out
+		for (std::uint32_t index = 0; index < generation.size(); ++index)
+		{
+			EntityId id{ index, generation[index] };
+			if (dead[index] || generation[index] == EntityRegistry::reservedGeneration) continue;
+			std::uint8_t isActive = m_registry.active(id);
+			auto &tags = m_registry.getTags(id);
+			auto tagCount = static_cast<std::uint32_t>(tags.size());
+			put(&id.index, sizeof(id.index));
+			put(&id.generation, sizeof(id.generation));
+			put(&isActive, sizeof(isActive));
+			put(&tagCount, sizeof(tagCount));
+			for (auto &tag : tags)
+			{
+				auto length = static_cast<std::uint32_t>(tag.size());
+				put(&length, sizeof(length));
+				put(tag.data(), length);
+			}
+		}
+		writeSection(file, raw, m_compress ? BlockEncoding::lz : BlockEncoding::raw, 1);
+		auto typeCount = static_cast<std::uint32_t>(m_types.size());
+		std::fwrite(&typeCount, sizeof(typeCount), 1, file);
+		for (auto &t : m_types)
+		{
+			raw.clear();
+			t.save(m_registry, raw);
+			auto stride = sizeof(std::uint32_t) + t.size;
+			count = static_cast<std::uint32_t>(raw.size() / stride);
+			std::fwrite(&t.key, sizeof(t.key), 1, file);
+			std::fwrite(&t.size, sizeof(t.size), 1, file);
+			std::fwrite(&count, sizeof(count), 1, file);
+			writeSection(file, raw, m_compress ? t.encoding : BlockEncoding::raw, stride);
+		}
+		bool ok = !std::ferror(file);
+		return std::fclose(file) == 0 && ok;
+	}
+
+	void Journal::writeSection(std::FILE *file, const std::vector<unsigned char> &raw, BlockEncoding encoding, std::size_t stride)
+	{
+		// Frames hold whole records so delta encoding never straddles two of them
+		auto chunk = std::max(sectionFrameSize / stride, std::size_t{ 1 }) * stride;
+		auto frames = encodeFrames(raw.data(), raw.size(), chunk, encoding, stride);
+		std::uint64_t rawSize = raw.size();
+		auto frameCount = static_cast<std::uint32_t>(frames.size());
+		std::fwrite(&rawSize, sizeof(rawSize), 1, file);
+		std::fwrite(&frameCount, sizeof(frameCount), 1, file);
+		for (auto &f : frames)
+			std::fwrite(f.data(), 1, f.size(), file);
+	}
+
+	// Records
+
+	void Journal::beginRecord(std::uint8_t op, EntityId id)
+	{
+		put(&op, sizeof(op));
+		put(&id.index, sizeof(id.index));
+		put(&id.generation, sizeof(id.generation));
+	}
+
+	void Journal::endRecord()
+	{
+		++m_records;
+		if (m_block.size() >= blockSize) flush();
+	}
+
+	void Journal::onCreate(EntityId id)
+	{
+		beginRecord(opCreate, id);
+		endRecord();
+	}
+
+	void Journal::onDestroy(EntityId id)
+	{
+		beginRecord(opDestroy, id);
+		endRecord();
+	}
+
+	void Journal::onActiveChanged(EntityId id, bool b)
+	{
+		std::uint8_t value = b;
+		beginRecord(opActive, id);
+		put(&value, sizeof(value));
+		endRecord();
+	}
+
+	void Journal::onComponentSet(EntityId id, std::size_t tid, const void *value)
+	{
+		if (tid >= m_byTid.size() || m_byTid[tid] < 0) return;
+		auto &t = m_types[m_byTid[tid]];
+		beginRecord(opSet, id);
+		put(&t.key, sizeof(t.key));
+		put(&t.size, sizeof(t.size));
+		put(value, t.size);
+		endRecord();
+	}
+
+	void Journal::onComponentRemoved(EntityId id, std::size_t tid)
+	{
+		if (tid >= m_byTid.size() || m_byTid[tid] < 0) return;
+		beginRecord(opRemove, id);
+		put(&m_types[m_byTid[tid]].key, sizeof(std::uint64_t));
+		endRecord();
+	}
+
+	void Journal::onTagAdded(EntityId id, const std::string &tag)
+	{
+		auto length = static_cast<std::uint32_t>(tag.size());
+		beginRecord(opTagAdd, id);
+		put(&length, sizeof(length));
+		put(tag.data(), length);
+		endRecord();
+	}
+
+	void Journal::onTagRemoved(EntityId id, const std::string &tag)
+	{
+		auto length = static_cast<std::uint32_t>(tag.size());
+		beginRecord(opTagRemove, id);
+		put(&length, sizeof(length));
+		put(tag.data(), length);
+		endRecord();
+	}
+
+	void Journal::onMerged(EntityRange range)
+	{
+		// The unused tail of the range went onto the free list
+		std::vector<bool> dead(range.count);
+		for (auto index : m_registry.m_free)
+		{
+			if (index - range.first < range.count) dead[index - range.first] = true;
+		}
+		for (auto index = range.first; index < range.first + range.count; ++index)
+		{
+			if (dead[index - range.first]) continue;
+			EntityId id{ index, m_registry.m_generation[index] };
+			onCreate(id);
+			for (auto &tag : m_registry.getTags(id))
+				onTagAdded(id, tag);
+			for (auto &t : m_types)
+			{
+				auto value = t.find(m_registry, id);
+				if (value) onComponentSet(id, t.tid, value);
+			}
+			if (!m_registry.active(id)) onActiveChanged(id, false);
+		}
+	}
+
+	// Writer thread
+
+	void Journal::flush()
+	{
+		if (m_block.empty() || !m_file) return;
+		std::vector<unsigned char> next;
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_queue.push_back(std::move(m_block));
+			++m_submitted;
+			if (!m_spare.empty())
+			{
+				next = std::move(m_spare.back());
+				m_spare.pop_back();
+			}
+		}
+		m_wake.notify_one();
+		m_block = std::move(next);
+		if (m_block.capacity() < blockSize) m_block.reserve(blockSize);
+	}
+
+	void Journal::sync()
+	{
+		flush();
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_written.wait(lock, [this] { return m_done == m_submitted; });
+	}
+
+	Journal::JournalStats Journal::stats() const
+	{
+		return JournalStats{ m_records, m_blocksWritten, m_rawBytes, m_bytesWritten, m_failed };
+	}
+
+	void Journal::stopWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		if (m_writer.joinable()) m_writer.join();
+		if (m_file) std::fclose(m_file);
+		m_file = nullptr;
+	}
+
+	void Journal::writerLoop()
+	{
+		// Compressed frames are built here, off the registry's thread
+		std::vector<unsigned char> frame;
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		for (;;)
+		{
+			m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty()) return;
+			auto block = std::move(m_queue.front());
+			m_queue.pop_front();
+			auto file = m_file;
+			lock.unlock();
+
+			if (!m_failed)
+			{
+				frame.clear();
+				encodeFrame(block.data(), block.size(), m_compress ? BlockEncoding::lz : BlockEncoding::raw, 1, frame);
+				auto sum = checksum(frame.data(), frame.size());
+				bool ok = std::fwrite(&sum, sizeof(sum), 1, file) == 1 &&
+					std::fwrite(frame.data(), 1, frame.size(), file) == frame.size() && std::fflush(file) == 0;
+				if (ok)
+				{
+					++m_blocksWritten;
+					m_rawBytes += block.size();
+					m_bytesWritten += sizeof(sum) + frame.size();
+				}
+				else m_failed = true;
+			}
+			block.clear();
+
+			lock.lock();
+			m_spare.push_back(std::move(block));
+			++m_done;
+			m_written.notify_all();
+		}
+	}
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include "EntityRegistry.h"
+#include "Compress.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace sde
+{
+
+	/* Journal - Write-ahead log of an EntityRegistry's structural changes, for crash
+	recovery between full snapshots. Entity create/destroy and activity, component
+	add/remove/modify and tag changes are appended as records to an in-memory block.
+	Full blocks, and the partial one on flush(), are handed to a writer thread that
+	appends them to the journal file, so the simulation thread never waits on I/O.
+	snapshot() writes the whole registry and restarts the journal; recover() loads
+	the last snapshot and replays the journal written after it:
+
+		Journal journal{ registry, "world.snap", "world.wal" };
+		journal.registerComponent<Position>("Position");
+		journal.recover();
+		journal.snapshot(); // journaling starts here
+		...
+		journal.flush(); // once per tick
+
+	Only components of registered types are recorded. They are stored by value, so
+	they must be trivially copyable, and their names identify them across runs.
+	Shared components and custom pools are not journaled. Blocks are checksummed and
+	replay stops at the first torn one; a crash of the process loses the records not
+	written yet, normally those since the last flush. The file is not fsynced, so
+	this does not cover a crash of the machine.
+
+	With setCompression, journal blocks are compressed on the writer thread and the
+	snapshot's entity table and component columns are written as compressed frames,
+	each column with the encoding it was registered with (deltaLz suits numeric
+	fields that change little from one entity to the next). Frames decode in
+	parallel on recover. Either kind of file is read back whatever the setting.
+	*/
+
+	class Journal : public RegistryObserver
+	{
+	public:
+		static constexpr std::size_t blockSize = 64 * 1024;
+		// Raw bytes per snapshot frame
+		static constexpr std::size_t sectionFrameSize = 1024 * 1024;
+
+		struct JournalStats
+		{
+			std::size_t records;
+			std::size_t blocksWritten;
+			// Journal bytes before and after compression
+			std::size_t rawBytes;
+			std::size_t bytesWritten;
+			// Set once a write to the journal file fails; journaling then stops
+			bool failed;
+		};
+
+		Journal(EntityRegistry &registry, const std::string &snapshotPath, const std::string &journalPath);
+		~Journal();
+		Journal(const Journal &other) = delete;
+		Journal &operator=(const Journal &other) = delete;
+
+		// encoding applies to the component's snapshot column once compression is on
+		template<typename T>
+		void registerComponent(const std::string &name, BlockEncoding encoding = BlockEncoding::lz)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "journaled components are recorded by value");
+			TypeInfo info;
+			info.key = nameKey(name);
+			info.tid = componentTypeId<ComponentPool<T>>();
+			info.size = sizeof(T);
+			info.encoding = encoding;
+			info.set = [](EntityRegistry &registry, EntityId id, const void *data)
+			{
+				alignas(T) unsigned char buffer[sizeof(T)];
+				std::memcpy(buffer, data, sizeof(T));
+				registry.addComponent<T>(id, *reinterpret_cast<const T *>(buffer));
+			};
+			info.remove = [](EntityRegistry &registry, EntityId id)
+			{
+				registry.removeComponent<T>(id);
+			};
+			info.find = [](EntityRegistry &registry, EntityId id) -> const void *
+			{
+				return registry.getComponent<T>(id);
+			};
+			info.save = [](EntityRegistry &registry, std::vector<unsigned char> &out)
+			{
+				auto &pool = registry.pool<T>();
+				auto base = out.size();
+				out.resize(base + pool.size() * (sizeof(std::uint32_t) + sizeof(T)));
+				auto p = out.data() + base;
+				pool.each([&p](EntityId id, T &c)
+				{
+					std::memcpy(p, &id.index, sizeof(id.index));
+					std::memcpy(p + sizeof(id.index), &c, sizeof(T));
+					p += sizeof(id.index) + sizeof(T);
+				});
+			};
+			addType(info);
+		}
+
+		// Loads the snapshot and replays the journal into the registry, which must not
+		// have created any entity yet. Missing files count as an empty world. Returns
+		// false if the snapshot is unreadable, leaving the registry partly loaded.
+		bool recover();
+		// Writes every entity, tag and registered component to the snapshot file and
+		// restarts the journal; the first call starts journaling. Runs on the
+		// registry's thread and waits for the writer. Returns false, keeping the
+		// previous snapshot, if it cannot be written or entities are paged out. Also
+		// returns false, with journaling stopped and stats().failed set, if the
+		// snapshot was written but the journal file could not be restarted.
+		bool snapshot();
+		// Off by default; takes effect from the next block and snapshot
+		inline void setCompression(bool b)
+		{
+			m_compress = b;
+		}
+		// Hands the records so far to the writer thread
+		void flush();
+		// Flushes and waits until the writer has written everything
+		void sync();
+		JournalStats stats() const;
+
+		void onCreate(EntityId id) override;
+		void onDestroy(EntityId id) override;
+		void onActiveChanged(EntityId id, bool b) override;
+		void onComponentSet(EntityId id, std::size_t tid, const void *value) override;
+		void onComponentRemoved(EntityId id, std::size_t tid) override;
+		void onTagAdded(EntityId id, const std::string &tag) override;
+		void onTagRemoved(EntityId id, const std::string &tag) override;
+		void onMerged(EntityRange range) override;
+
+	private:
+		struct TypeInfo
+		{
+			// Hash of the registered name
+			std::uint64_t key;
+			std::size_t tid;
+			std::uint32_t size;
+			BlockEncoding encoding;
+			void (*set)(EntityRegistry &, EntityId, const void *);
+			void (*remove)(EntityRegistry &, EntityId);
+			const void *(*find)(EntityRegistry &, EntityId);
+			// Appends the column: entity index and value per component
+			void (*save)(EntityRegistry &, std::vector<unsigned char> &);
+		};
+
+		// Frames read from a file, and the buffer they decode into
+		struct Frame
+		{
+			std::size_t offset;
+			std::uint32_t rawSize;
+		};
+		struct Section
+		{
+			std::vector<unsigned char> stored;
+			std::vector<Frame> frames;
+			std::vector<unsigned char> raw;
+		};
+
+		static std::uint64_t nameKey(const std::string &name);
+		void addType(const TypeInfo &info);
+		const TypeInfo *typeOf(std::uint64_t key) const;
+
+		inline void put(const void *data, std::size_t size)
+		{
+			auto p = static_cast<const unsigned char *>(data);
+			m_block.insert(std::end(m_block), p, p + size);
+		}
+		void beginRecord(std::uint8_t op, EntityId id);
+		void endRecord();
+		bool writeSnapshot(const std::string &path, std::uint64_t sequence);
+		void writeSection(std::FILE *file, const std::vector<unsigned char> &raw, BlockEncoding encoding, std::size_t stride);
+		static bool readFrame(std::FILE *file, Section &section);
+		static bool readSection(std::FILE *file, Section &section);
+		static bool decodeSections(std::vector<Section> &sections);
+		void replay(const unsigned char *data, std::size_t size);
+		void stopWriter();
+		void writerLoop();
+
+		EntityRegistry &m_registry;
+		std::string m_snapshotPath;
+		std::string m_journalPath;
+		std::vector<TypeInfo> m_types;
+		// Index into m_types per component type id, -1 if not registered
+		std::vector<int> m_byTid;
+		std::uint64_t m_sequence;
+		std::size_t m_records;
+
+		// Block being filled by the registry's thread
+		std::vector<unsigned char> m_block;
+
+		// Shared with the writer thread
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_written;
+		std::deque<std::vector<unsigned char>> m_queue;
+		// Written blocks, reused so steady-state journaling does not allocate
+		std::vector<std::vector<unsigned char>> m_spare;
+		std::size_t m_submitted;
+		std::size_t m_done;
+		bool m_stop;
+		std::FILE *m_file;
+		std::thread m_writer;
+		std::atomic<std::size_t> m_blocksWritten;
+		std::atomic<std::size_t> m_rawBytes;
+		std::atomic<std::size_t> m_bytesWritten;
+		std::atomic<bool> m_failed;
+		std::atomic<bool> m_compress;
+	};
+}
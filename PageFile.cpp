@@ -0,0 +1,99 @@
+#include "PageFile.h"
+#include <new>
+#include <algorithm>
+#if defined(__unix__) || defined(__APPLE__)
+#define SDE_HAS_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace sde
+{
+	PageFile::PageFile() :
+		m_fd{ -1 }, m_base{ nullptr }, m_size{ 0 }, m_end{ 0 }
+	{}
+
+	PageFile::~PageFile()
+	{
+		close();
+	}
+
+	bool PageFile::open(const std::string &path)
+	{
+		close();
+#if defined(SDE_HAS_MMAP)
+		m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (m_fd < 0) return false;
+		if (!grow(std::size_t{ 1 } << 20))
+		{
+			close();
+			return false;
+		}
+		return true;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+	void PageFile::close()
+	{
+#if defined(SDE_HAS_MMAP)
+		if (m_base) munmap(m_base, m_size);
+		if (m_fd >= 0) ::close(m_fd);
+#endif
+		m_fd = -1;
+		m_base = nullptr;
+		m_size = 0;
+		m_end = 0;
+		m_free.clear();
+	}
+
+	std::size_t PageFile::sizeClass(std::size_t size)
+	{
+		std::size_t c = 0;
+		while ((std::size_t{ 1 } << (c + minBlockBits)) < size)
+			++c;
+		return c;
+	}
+
+	std::uint64_t PageFile::allocate(std::size_t size)
+	{
+		auto c = sizeClass(size);
+		if (c < m_free.size() && !m_free[c].empty())
+		{
+			auto offset = m_free[c].back();
+			m_free[c].pop_back();
+			return offset;
+		}
+		auto block = std::size_t{ 1 } << (c + minBlockBits);
+		if (m_end + block > m_size && !grow(std::max(m_size * 2, m_end + block))) throw std::bad_alloc{};
+		auto offset = m_end;
+		m_end += block;
+		return offset;
+	}
+
+	void PageFile::release(std::uint64_t offset, std::size_t size)
+	{
+		auto c = sizeClass(size);
+		if (c >= m_free.size()) m_free.resize(c + 1);
+		m_free[c].push_back(offset);
+	}
+
+	bool PageFile::grow(std::size_t minSize)
+	{
+#if defined(SDE_HAS_MMAP)
+		if (ftruncate(m_fd, static_cast<off_t>(minSize)) != 0) return false;
+		auto p = mmap(nullptr, minSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (p == MAP_FAILED) return false;
+		if (m_base) munmap(m_base, m_size);
+		m_base = static_cast<unsigned char *>(p);
+		m_size = minSize;
+		return true;
+#else
+		(void)minSize;
+		return false;
+#endif
+	}
+}
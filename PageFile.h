@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sde
+{
+
+	/* PageFile - Growable memory-mapped file carved into power-of-two blocks (64
+	bytes and up) with a free list per size, used as the backing store for paged-out
+	entities. Pointers returned by at() stay valid until the next allocate, which
+	may remap the file. The file is scratch space: it is truncated on open and its
+	contents are not meant to outlive the process.
+	*/
+
+	class PageFile
+	{
+	public:
+		static constexpr std::size_t minBlockBits = 6;
+
+		PageFile();
+		~PageFile();
+		PageFile(const PageFile &other) = delete;
+		PageFile &operator=(const PageFile &other) = delete;
+
+		// Creates or truncates the file at path; returns false if it cannot be mapped
+		bool open(const std::string &path);
+		inline bool isOpen() const
+		{
+			return m_base != nullptr;
+		}
+		// Offset of a block of at least size bytes
+		std::uint64_t allocate(std::size_t size);
+		void release(std::uint64_t offset, std::size_t size);
+		inline unsigned char *at(std::uint64_t offset) const
+		{
+			return m_base + offset;
+		}
+		inline std::size_t fileSize() const
+		{
+			return m_size;
+		}
+
+	private:
+		static std::size_t sizeClass(std::size_t size);
+		bool grow(std::size_t minSize);
+		void close();
+
+		int m_fd;
+		unsigned char *m_base;
+		std::size_t m_size;
+		// End of the blocks handed out so far
+		std::size_t m_end;
+		std::vector<std::vector<std::uint64_t>> m_free;
+	};
+}
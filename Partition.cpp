@@ -0,0 +1,20 @@
+#include "Partition.h"
+
+namespace sde
+{
+	Partition::Partition(EntityRegistry &live, std::size_t capacity) :
+		m_range{ live.reserveRange(capacity) }, m_used{ 0 }, m_resource{ live.resource() },
+		m_pools{ m_resource }, m_tags{ m_resource }
+	{}
+
+	EntityId Partition::create()
+	{
+		if (m_used == m_range.count) return nullEntity;
+		return EntityId{ m_range.first + m_used++, 0 };
+	}
+
+	void Partition::addTag(EntityId id, const std::string &tag)
+	{
+		m_tags[id.index].emplace_back(tag);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "EntityRegistry.h"
+
+namespace sde
+{
+
+	/* Partition - Staging area for streaming a region of a world in. Constructing
+	it reserves a range of entity indices in the live registry; after that, it can
+	be filled on a background thread without touching the live registry, and is
+	spliced in with EntityRegistry::merge on the live registry's thread:
+
+		auto cell = std::make_unique<Partition>(registry, 4096);
+		auto loaded = std::async(std::launch::async, [&] { buildCell(*cell); });
+		...
+		loaded.get();
+		registry.merge(*cell);
+
+	Staged pools allocate from the live registry's memory resource, so pools the
+	live registry does not have yet can be adopted as they are. If partitions are
+	built while the world runs, that resource must be thread safe. Hierarchy links
+	to entities outside the partition are made after the merge. A partition that is
+	dropped without merging keeps its range reserved until registry.unload(range()).
+	*/
+
+	class Partition
+	{
+	public:
+		Partition(EntityRegistry &live, std::size_t capacity);
+		Partition(const Partition &other) = delete;
+		Partition &operator=(const Partition &other) = delete;
+
+		// Returns nullEntity once the reserved range is used up
+		EntityId create();
+		inline std::size_t size() const
+		{
+			return m_used;
+		}
+		inline EntityRange range() const
+		{
+			return m_range;
+		}
+
+		template<typename T, typename ...Args>
+		T &addComponent(EntityId id, Args &&...args)
+		{
+			return poolOf<ComponentPool<T>>().emplace(id, std::forward<Args>(args)...);
+		}
+		template<typename T, typename Hash = std::hash<T>>
+		const T &setShared(EntityId id, const T &value)
+		{
+			return poolOf<SharedPool<T, Hash>>().set(id, value);
+		}
+		void addTag(EntityId id, const std::string &tag);
+		template<typename PoolT>
+		PoolT &poolOf()
+		{
+			auto tid = componentTypeId<PoolT>();
+			if (tid >= m_pools.size()) m_pools.resize(tid + 1);
+			if (!m_pools[tid]) m_pools[tid] = makeResourcePtr<PoolT>(m_resource);
+			return *static_cast<PoolT *>(m_pools[tid].get());
+		}
+
+	private:
+		friend class EntityRegistry;
+
+		EntityRange m_range;
+		std::uint32_t m_used;
+		std::pmr::memory_resource *m_resource;
+		std::pmr::vector<ResourcePtr<PoolBase>> m_pools;
+		std::pmr::unordered_map<std::uint32_t, std::vector<std::string>> m_tags;
+	};
+}
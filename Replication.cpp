@@ -0,0 +1,401 @@
+#include "Replication.h"
+
+namespace sde
+{
+	namespace
+	{
+		// Entity operations in a delta
+		enum Op : std::uint32_t
+		{
+			opUpdate,
+			opSpawn,
+			opDespawn
+		};
+
+		inline std::uint32_t golombBits(std::uint32_t value)
+		{
+			std::uint64_t v = std::uint64_t{ value } + 1;
+			unsigned n = 0;
+			for (; v; v >>= 1)
+				++n;
+			return 2 * n - 1;
+		}
+
+		inline std::uint64_t zigzag(std::int64_t d)
+		{
+			return (static_cast<std::uint64_t>(d) << 1) ^ static_cast<std::uint64_t>(d >> 63);
+		}
+
+		inline std::int64_t unzigzag(std::uint32_t z)
+		{
+			return static_cast<std::int64_t>(z >> 1) ^ -static_cast<std::int64_t>(z & 1);
+		}
+
+		inline bool has(const ReplicationState::Entity &e, std::size_t c)
+		{
+			return (e.components >> c) & 1;
+		}
+	}
+
+	// Bit packing
+
+	void BitWriter::spill()
+	{
+		for (; m_count >= 8; m_count -= 8)
+		{
+			m_bytes.push_back(static_cast<unsigned char>(m_acc));
+			m_acc >>= 8;
+		}
+	}
+
+	void BitWriter::writeGolomb(std::uint32_t value)
+	{
+		std::uint64_t v = std::uint64_t{ value } + 1;
+		unsigned n = 0;
+		for (auto t = v; t; t >>= 1)
+			++n;
+		// n - 1 zeros and the leading 1 of v, then the n - 1 bits below it
+		write(0, n - 1);
+		write(1, 1);
+		write(static_cast<std::uint32_t>(v), n - 1);
+	}
+
+	const std::vector<unsigned char> &BitWriter::finish()
+	{
+		spill();
+		if (m_count)
+		{
+			m_bytes.push_back(static_cast<unsigned char>(m_acc));
+			m_acc = 0;
+			m_count = 0;
+		}
+		return m_bytes;
+	}
+
+	void BitWriter::clear()
+	{
+		m_bytes.clear();
+		m_acc = 0;
+		m_count = 0;
+	}
+
+	void BitReader::refill(unsigned bits)
+	{
+		while (m_count <= 56 && m_p != m_end)
+		{
+			m_acc |= std::uint64_t{ *m_p++ } << m_count;
+			m_count += 8;
+		}
+		if (m_count < bits)
+		{
+			m_ok = false;
+			m_count = bits;
+		}
+	}
+
+	std::uint32_t BitReader::readGolomb()
+	{
+		unsigned zeros = 0;
+		while (!readBit())
+		{
+			if (++zeros > 32 || !m_ok)
+			{
+				m_ok = false;
+				return 0;
+			}
+		}
+		auto v = (std::uint64_t{ 1 } << zeros) | read(zeros);
+		return static_cast<std::uint32_t>(v - 1);
+	}
+
+	// Schema
+
+	void ReplicationSchema::addField(std::size_t component, const FieldSpec &f)
+	{
+		if (component == rejected) return;
+		m_components[component].fields.push_back(f);
+		// Later components' rows move up by one
+		for (auto c = component + 1; c < m_components.size(); ++c)
+			++m_components[c].firstValue;
+		++m_valueCount;
+	}
+
+	// Encoding
+
+	ReplicationState ReplicationEncoder::capture(EntityRegistry &registry, const std::vector<EntityId> &relevant) const
+	{
+		ReplicationState state;
+		state.entities.reserve(relevant.size());
+		for (auto id : relevant)
+		{
+			if (registry.valid(id)) state.entities.push_back(ReplicationState::Entity{ id, 0 });
+		}
+		std::sort(std::begin(state.entities), std::end(state.entities), [](const ReplicationState::Entity &a, const ReplicationState::Entity &b)
+		{
+			return a.id.index < b.id.index;
+		});
+		state.entities.erase(std::unique(std::begin(state.entities), std::end(state.entities), [](const ReplicationState::Entity &a, const ReplicationState::Entity &b)
+		{
+			return a.id.index == b.id.index;
+		}), std::end(state.entities));
+
+		auto &components = m_schema.components();
+		auto stride = m_schema.valueCount();
+		state.values.assign(state.entities.size() * stride, 0);
+		for (std::size_t i = 0; i < state.entities.size(); ++i)
+		{
+			auto &e = state.entities[i];
+			auto row = state.values.data() + i * stride;
+			for (std::size_t c = 0; c < components.size(); ++c)
+			{
+				auto cp = static_cast<const unsigned char *>(components[c].find(registry, e.id));
+				if (!cp) continue;
+				e.components |= std::uint64_t{ 1 } << c;
+				auto &fields = components[c].fields;
+				for (std::size_t f = 0; f < fields.size(); ++f)
+					row[components[c].firstValue + f] = fields[f].quantize(fields[f], cp);
+			}
+		}
+		return state;
+	}
+
+	void ReplicationEncoder::encode(const ReplicationState &baseline, const ReplicationState &current, BitWriter &out) const
+	{
+		auto stride = m_schema.valueCount();
+		auto rowBytes = stride * sizeof(std::uint32_t);
+		std::size_t b = 0, c = 0;
+		std::int64_t last = -1;
+		auto header = [&out, &last](std::uint32_t index, Op op)
+		{
+			out.writeBit(true);
+			out.writeGolomb(static_cast<std::uint32_t>(index - last - 1));
+			out.write(op, 2);
+			last = index;
+		};
+		while (b < baseline.entities.size() || c < current.entities.size())
+		{
+			auto bi = b < baseline.entities.size() ? baseline.entities[b].id.index : 0xffffffffu;
+			auto ci = c < current.entities.size() ? current.entities[c].id.index : 0xffffffffu;
+			if (bi < ci)
+			{
+				header(bi, opDespawn);
+				++b;
+				continue;
+			}
+			auto &e = current.entities[c];
+			auto values = current.values.data() + c * stride;
+			if (bi == ci && baseline.entities[b].id.generation == e.id.generation)
+			{
+				auto &old = baseline.entities[b];
+				auto oldValues = baseline.values.data() + b * stride;
+				if (old.components != e.components || std::memcmp(oldValues, values, rowBytes) != 0)
+				{
+					header(ci, opUpdate);
+					writeComponents(&old, oldValues, e, values, out);
+				}
+				++b;
+			}
+			else
+			{
+				// A recycled index is a new entity
+				if (bi == ci) ++b;
+				header(ci, opSpawn);
+				out.writeGolomb(e.id.generation);
+				writeComponents(nullptr, nullptr, e, values, out);
+			}
+			++c;
+		}
+		out.writeBit(false);
+	}
+
+	void ReplicationEncoder::writeComponents(const ReplicationState::Entity *old, const std::uint32_t *oldValues,
+		const ReplicationState::Entity &e, const std::uint32_t *values, BitWriter &out) const
+	{
+		auto &components = m_schema.components();
+		for (std::size_t c = 0; c < components.size(); ++c)
+		{
+			out.writeBit(has(e, c));
+			if (!has(e, c)) continue;
+			auto &fields = components[c].fields;
+			auto first = components[c].firstValue;
+			if (!old || !has(*old, c))
+			{
+				for (std::size_t f = 0; f < fields.size(); ++f)
+					out.write(values[first + f], fields[f].bits);
+				continue;
+			}
+			bool changed = std::memcmp(oldValues + first, values + first, fields.size() * sizeof(std::uint32_t)) != 0;
+			out.writeBit(changed);
+			if (!changed) continue;
+			for (std::size_t f = 0; f < fields.size(); ++f)
+			{
+				auto v = values[first + f];
+				out.writeBit(v != oldValues[first + f]);
+				if (v == oldValues[first + f]) continue;
+				auto z = zigzag(std::int64_t{ v } - std::int64_t{ oldValues[first + f] });
+				bool small = z < 0xffffffffu && golombBits(static_cast<std::uint32_t>(z)) < fields[f].bits;
+				out.writeBit(small);
+				if (small) out.writeGolomb(static_cast<std::uint32_t>(z));
+				else out.write(v, fields[f].bits);
+			}
+		}
+	}
+
+	// Decoding
+
+	bool ReplicationDecoder::decode(const ReplicationState &baseline, BitReader &in, ReplicationState &state) const
+	{
+		auto stride = m_schema.valueCount();
+		state.entities.clear();
+		state.values.clear();
+		std::size_t b = 0;
+		std::int64_t last = -1;
+		// Copies baseline entities below index, which did not change
+		auto keepUntil = [&](std::int64_t index)
+		{
+			for (; b < baseline.entities.size() && baseline.entities[b].id.index < index; ++b)
+			{
+				state.entities.push_back(baseline.entities[b]);
+				auto row = baseline.values.data() + b * stride;
+				state.values.insert(std::end(state.values), row, row + stride);
+			}
+		};
+		while (in.readBit())
+		{
+			auto index = last + 1 + in.readGolomb();
+			auto op = in.read(2);
+			if (!in.ok() || index > 0xffffffffll) return false;
+			last = index;
+			keepUntil(index);
+			const ReplicationState::Entity *old = nullptr;
+			const std::uint32_t *oldValues = nullptr;
+			if (b < baseline.entities.size() && baseline.entities[b].id.index == index)
+			{
+				old = &baseline.entities[b];
+				oldValues = baseline.values.data() + b * stride;
+				++b;
+			}
+			if (op == opDespawn)
+			{
+				if (!old) return false;
+				continue;
+			}
+			ReplicationState::Entity e{ EntityId{ static_cast<std::uint32_t>(index), 0 }, 0 };
+			if (op == opUpdate)
+			{
+				if (!old) return false;
+				e.id = old->id;
+			}
+			else if (op == opSpawn)
+			{
+				e.id.generation = in.readGolomb();
+				old = nullptr;
+				oldValues = nullptr;
+			}
+			else return false;
+			state.values.resize(state.values.size() + stride, 0);
+			if (!readComponents(old, oldValues, e, state.values.data() + state.values.size() - stride, in)) return false;
+			state.entities.push_back(e);
+		}
+		keepUntil(std::int64_t{ 1 } << 32);
+		return in.ok();
+	}
+
+	bool ReplicationDecoder::readComponents(const ReplicationState::Entity *old, const std::uint32_t *oldValues,
+		ReplicationState::Entity &e, std::uint32_t *values, BitReader &in) const
+	{
+		auto &components = m_schema.components();
+		for (std::size_t c = 0; c < components.size(); ++c)
+		{
+			if (!in.readBit()) continue;
+			e.components |= std::uint64_t{ 1 } << c;
+			auto &fields = components[c].fields;
+			auto first = components[c].firstValue;
+			if (!old || !has(*old, c))
+			{
+				for (std::size_t f = 0; f < fields.size(); ++f)
+					values[first + f] = in.read(fields[f].bits);
+				continue;
+			}
+			std::memcpy(values + first, oldValues + first, fields.size() * sizeof(std::uint32_t));
+			if (!in.readBit()) continue;
+			for (std::size_t f = 0; f < fields.size(); ++f)
+			{
+				if (!in.readBit()) continue;
+				if (!in.readBit())
+				{
+					values[first + f] = in.read(fields[f].bits);
+					continue;
+				}
+				// The encoder only sends deltas that land inside the field, anything else is corrupt
+				auto value = std::int64_t{ oldValues[first + f] } + unzigzag(in.readGolomb());
+				if (value < 0 || (value >> fields[f].bits) != 0) return false;
+				values[first + f] = static_cast<std::uint32_t>(value);
+			}
+		}
+		return in.ok();
+	}
+
+	void ReplicationDecoder::apply(const ReplicationState &from, const ReplicationState &to)
+	{
+		auto stride = m_schema.valueCount();
+		std::size_t f = 0, t = 0;
+		while (f < from.entities.size() || t < to.entities.size())
+		{
+			auto fi = f < from.entities.size() ? std::int64_t{ from.entities[f].id.index } : std::int64_t{ 1 } << 32;
+			auto ti = t < to.entities.size() ? std::int64_t{ to.entities[t].id.index } : std::int64_t{ 1 } << 32;
+			bool same = fi == ti && from.entities[f].id.generation == to.entities[t].id.generation;
+			if (fi < ti || (fi == ti && !same))
+			{
+				auto it = m_local.find(from.entities[f].id.index);
+				if (it != std::end(m_local))
+				{
+					m_client.destroy(it->second);
+					m_local.erase(it);
+				}
+				++f;
+				// A respawned index is handled as a new entity on the next pass
+				continue;
+			}
+			auto values = to.values.data() + t * stride;
+			if (same)
+			{
+				applyEntity(&from.entities[f], from.values.data() + f * stride, to.entities[t], values);
+				++f;
+			}
+			else applyEntity(nullptr, nullptr, to.entities[t], values);
+			++t;
+		}
+	}
+
+	void ReplicationDecoder::applyEntity(const ReplicationState::Entity *old, const std::uint32_t *oldValues,
+		const ReplicationState::Entity &e, const std::uint32_t *values)
+	{
+		auto &local = m_local[e.id.index];
+		if (!old || !m_client.valid(local))
+		{
+			// A recreated entity has none of the old components, so every one is applied
+			local = m_client.create();
+			old = nullptr;
+		}
+		auto &components = m_schema.components();
+		for (std::size_t c = 0; c < components.size(); ++c)
+		{
+			auto &spec = components[c];
+			bool had = old && has(*old, c);
+			if (!has(e, c))
+			{
+				if (had) spec.remove(m_client, local);
+				continue;
+			}
+			if (had && std::memcmp(oldValues + spec.firstValue, values + spec.firstValue, spec.fields.size() * sizeof(std::uint32_t)) == 0) continue;
+			spec.apply(m_client, local, spec, values + spec.firstValue);
+		}
+	}
+
+	EntityId ReplicationDecoder::local(EntityId remote) const
+	{
+		auto it = m_local.find(remote.index);
+		return it == std::end(m_local) ? nullEntity : it->second;
+	}
+}
@@ -0,0 +1,337 @@
+#pragma once
+#include "EntityRegistry.h"
+
+namespace sde
+{
+
+	/* BitWriter, BitReader - Bit-granular packing over a byte buffer, least
+	significant bit first. Values of up to 32 bits are written as is; writeGolomb
+	uses an Exp-Golomb code, so small numbers take few bits. Reading past the end
+	yields zeros and clears ok().
+	*/
+
+	class BitWriter
+	{
+	public:
+		BitWriter() :
+			m_acc{ 0 }, m_count{ 0 }
+		{}
+
+		inline void write(std::uint32_t value, unsigned bits)
+		{
+			m_acc |= std::uint64_t{ value & mask(bits) } << m_count;
+			m_count += bits;
+			if (m_count >= 32) spill();
+		}
+		inline void writeBit(bool b)
+		{
+			write(b ? 1 : 0, 1);
+		}
+		void writeGolomb(std::uint32_t value);
+		inline std::size_t bitSize() const
+		{
+			return m_bytes.size() * 8 + m_count;
+		}
+		// Pads the last byte and returns the buffer; writing may continue afterwards
+		const std::vector<unsigned char> &finish();
+		void clear();
+
+		static inline std::uint32_t mask(unsigned bits)
+		{
+			return bits >= 32 ? 0xffffffffu : (std::uint32_t{ 1 } << bits) - 1;
+		}
+	private:
+		void spill();
+
+		std::vector<unsigned char> m_bytes;
+		std::uint64_t m_acc;
+		unsigned m_count;
+	};
+
+	class BitReader
+	{
+	public:
+		BitReader(const void *data, std::size_t size) :
+			m_p{ static_cast<const unsigned char *>(data) }, m_end{ m_p + size }, m_acc{ 0 }, m_count{ 0 }, m_ok{ true }
+		{}
+
+		inline std::uint32_t read(unsigned bits)
+		{
+			if (m_count < bits) refill(bits);
+			auto value = static_cast<std::uint32_t>(m_acc) & BitWriter::mask(bits);
+			m_acc >>= bits;
+			m_count -= bits;
+			return value;
+		}
+		inline bool readBit()
+		{
+			return read(1) != 0;
+		}
+		std::uint32_t readGolomb();
+		inline bool ok() const
+		{
+			return m_ok;
+		}
+	private:
+		void refill(unsigned bits);
+
+		const unsigned char *m_p;
+		const unsigned char *m_end;
+		std::uint64_t m_acc;
+		unsigned m_count;
+		bool m_ok;
+	};
+
+	/* ReplicationSchema - Which components are replicated and how each field is
+	quantized. Floats map [min, max] onto bits; integers keep their low bits (signed
+	ones zigzag encoded, so small negatives stay small) and bools take one bit.
+	Fields that are not listed are not sent. Server and client build the same schema
+	in the same order:
+
+		schema.add<Position>()
+			.field(&Position::x, -4096.0f, 4096.0f, 20)
+			.field(&Position::y, -4096.0f, 4096.0f, 20);
+		schema.add<Health>().field(&Health::hp, 10);
+
+	Components must be trivially copyable and default constructible; at most 64
+	types can be replicated. Fields take 1 to 32 bits and ranged ones need
+	max > min. A call that breaks these limits is ignored and clears valid(), so
+	check it once the schema is built.
+	*/
+
+	class ReplicationSchema
+	{
+	public:
+		static constexpr std::size_t maxComponents = 64;
+
+		struct FieldSpec
+		{
+			std::size_t offset;
+			unsigned bits;
+			float min;
+			// Quantization steps per unit, for floats
+			float scale;
+			std::uint32_t (*quantize)(const FieldSpec &, const unsigned char *);
+			void (*dequantize)(const FieldSpec &, std::uint32_t, unsigned char *);
+		};
+
+		struct ComponentSpec
+		{
+			std::vector<FieldSpec> fields;
+			// Position of the first field in a state's value row
+			std::size_t firstValue;
+			const void *(*find)(EntityRegistry &, EntityId);
+			// Writes the fields to id's component, adding a default one first if needed
+			void (*apply)(EntityRegistry &, EntityId, const ComponentSpec &, const std::uint32_t *);
+			void (*remove)(EntityRegistry &, EntityId);
+		};
+
+		template<typename T>
+		class Fields
+		{
+		public:
+			Fields(ReplicationSchema &schema, std::size_t component) :
+				m_schema(schema), m_component{ component }
+			{}
+			template<typename M>
+			Fields &field(M T::*member, float min, float max, unsigned bits)
+			{
+				static_assert(std::is_floating_point<M>::value, "ranged fields are floating point");
+				// Also rejects NaN bounds
+				if (bits < 1 || bits > 32 || !(max > min))
+				{
+					m_schema.m_valid = false;
+					return *this;
+				}
+				FieldSpec f{ offsetOf(member), bits, min, static_cast<float>(BitWriter::mask(bits)) / (max - min),
+					&quantizeField<M>, &dequantizeField<M> };
+				m_schema.addField(m_component, f);
+				return *this;
+			}
+			template<typename M>
+			Fields &field(M T::*member, unsigned bits = 8 * sizeof(M))
+			{
+				static_assert(std::is_integral<M>::value && sizeof(M) <= 4, "unranged fields are integers of up to 32 bits");
+				if (bits < 1 || bits > 32)
+				{
+					m_schema.m_valid = false;
+					return *this;
+				}
+				FieldSpec f{ offsetOf(member), std::is_same<M, bool>::value ? 1 : bits, 0.0f, 1.0f, &quantizeField<M>, &dequantizeField<M> };
+				m_schema.addField(m_component, f);
+				return *this;
+			}
+		private:
+			template<typename M>
+			static std::size_t offsetOf(M T::*member)
+			{
+				T probe{};
+				return reinterpret_cast<const unsigned char *>(&(probe.*member)) - reinterpret_cast<const unsigned char *>(&probe);
+			}
+
+			ReplicationSchema &m_schema;
+			std::size_t m_component;
+		};
+
+		template<typename T>
+		Fields<T> add()
+		{
+			static_assert(std::is_trivially_copyable<T>::value && std::is_default_constructible<T>::value,
+				"replicated components are copied field by field");
+			// Components are tracked in a 64-bit mask per entity
+			if (m_components.size() == maxComponents)
+			{
+				m_valid = false;
+				return Fields<T>{ *this, rejected };
+			}
+			ComponentSpec c;
+			c.firstValue = m_valueCount;
+			c.find = [](EntityRegistry &registry, EntityId id) -> const void *
+			{
+				return registry.getComponent<T>(id);
+			};
+			c.apply = [](EntityRegistry &registry, EntityId id, const ComponentSpec &spec, const std::uint32_t *values)
+			{
+				auto cp = registry.getComponent<T>(id);
+				T value = cp ? *cp : T{};
+				auto bytes = reinterpret_cast<unsigned char *>(&value);
+				for (std::size_t i = 0; i < spec.fields.size(); ++i)
+					spec.fields[i].dequantize(spec.fields[i], values[i], bytes);
+				registry.addComponent<T>(id, value);
+			};
+			c.remove = [](EntityRegistry &registry, EntityId id)
+			{
+				registry.removeComponent<T>(id);
+			};
+			m_components.push_back(std::move(c));
+			return Fields<T>{ *this, m_components.size() - 1 };
+		}
+
+		inline const std::vector<ComponentSpec> &components() const
+		{
+			return m_components;
+		}
+		// Quantized values per entity
+		inline std::size_t valueCount() const
+		{
+			return m_valueCount;
+		}
+		// False once an add or field call was rejected
+		inline bool valid() const
+		{
+			return m_valid;
+		}
+
+	private:
+		void addField(std::size_t component, const FieldSpec &f);
+
+		template<typename M>
+		static std::uint32_t quantizeField(const FieldSpec &f, const unsigned char *component)
+		{
+			M v;
+			std::memcpy(&v, component + f.offset, sizeof(M));
+			if constexpr (std::is_floating_point<M>::value)
+			{
+				auto top = static_cast<float>(BitWriter::mask(f.bits));
+				auto q = (static_cast<float>(v) - f.min) * f.scale + 0.5f;
+				// Also catches NaN
+				if (!(q > 0.0f)) return 0;
+				return q >= top ? BitWriter::mask(f.bits) : static_cast<std::uint32_t>(q);
+			}
+			else if constexpr (std::is_signed<M>::value)
+			{
+				auto s = static_cast<std::int32_t>(v);
+				return ((static_cast<std::uint32_t>(s) << 1) ^ static_cast<std::uint32_t>(s >> 31)) & BitWriter::mask(f.bits);
+			}
+			else return static_cast<std::uint32_t>(v) & BitWriter::mask(f.bits);
+		}
+		template<typename M>
+		static void dequantizeField(const FieldSpec &f, std::uint32_t q, unsigned char *component)
+		{
+			M v;
+			if constexpr (std::is_same<M, bool>::value) v = q != 0;
+			else if constexpr (std::is_floating_point<M>::value) v = static_cast<M>(f.min + q / f.scale);
+			else if constexpr (std::is_signed<M>::value) v = static_cast<M>(static_cast<std::int32_t>(q >> 1) ^ -static_cast<std::int32_t>(q & 1));
+			else v = static_cast<M>(q);
+			std::memcpy(component + f.offset, &v, sizeof(M));
+		}
+
+		// Component index handed to the fields of a rejected add
+		static constexpr std::size_t rejected = ~std::size_t{ 0 };
+
+		std::vector<ComponentSpec> m_components;
+		std::size_t m_valueCount = 0;
+		bool m_valid = true;
+	};
+
+	/* ReplicationState - Quantized state of a set of entities as one side of the
+	connection has it: entities in index order, a mask of the replicated components
+	each one has, and a row of schema.valueCount() values per entity.
+	*/
+
+	struct ReplicationState
+	{
+		struct Entity
+		{
+			EntityId id;
+			std::uint64_t components;
+		};
+
+		std::vector<Entity> entities;
+		std::vector<std::uint32_t> values;
+	};
+
+	/* ReplicationEncoder - Server side. capture quantizes the relevant entities of a
+	registry; encode writes what changed from a baseline the client acknowledged to
+	the current state: spawned and despawned entities, and for the others only the
+	fields that changed, each as a small delta when that is shorter than the value.
+	Unchanged entities cost nothing. The caller keeps the states it sent until they
+	are acknowledged; an empty state is the baseline for a new client.
+	*/
+
+	class ReplicationEncoder
+	{
+	public:
+		explicit ReplicationEncoder(const ReplicationSchema &schema) :
+			m_schema(schema)
+		{}
+
+		ReplicationState capture(EntityRegistry &registry, const std::vector<EntityId> &relevant) const;
+		void encode(const ReplicationState &baseline, const ReplicationState &current, BitWriter &out) const;
+	private:
+		void writeComponents(const ReplicationState::Entity *old, const std::uint32_t *oldValues,
+			const ReplicationState::Entity &e, const std::uint32_t *values, BitWriter &out) const;
+
+		const ReplicationSchema &m_schema;
+	};
+
+	/* ReplicationDecoder - Client side. decode rebuilds the server's state from a
+	delta and the same baseline it was encoded against; apply then brings the
+	client registry from the state it shows now to the new one, creating, destroying
+	and writing only what differs. Client entities are created locally and mapped
+	from the server's ids.
+	*/
+
+	class ReplicationDecoder
+	{
+	public:
+		ReplicationDecoder(const ReplicationSchema &schema, EntityRegistry &client) :
+			m_schema(schema), m_client(client)
+		{}
+
+		// Returns false on malformed input
+		bool decode(const ReplicationState &baseline, BitReader &in, ReplicationState &state) const;
+		void apply(const ReplicationState &from, const ReplicationState &to);
+		// Client entity for a server entity, nullEntity if it is not replicated
+		EntityId local(EntityId remote) const;
+	private:
+		bool readComponents(const ReplicationState::Entity *old, const std::uint32_t *oldValues,
+			ReplicationState::Entity &e, std::uint32_t *values, BitReader &in) const;
+		void applyEntity(const ReplicationState::Entity *old, const std::uint32_t *oldValues,
+			const ReplicationState::Entity &e, const std::uint32_t *values);
+
+		const ReplicationSchema &m_schema;
+		EntityRegistry &m_client;
+		std::unordered_map<std::uint32_t, EntityId> m_local;
+	};
+}
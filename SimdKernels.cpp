@@ -0,0 +1,352 @@
+#include "SimdKernels.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SDE_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SDE_TARGET(isa)
+#else
+#define SDE_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace sde
+{
+	namespace
+	{
+		// Scalar reference implementations, also used for vector tails
+
+		void integrateScalar(float *px, float *py, float *pz,
+			const float *vx, const float *vy, const float *vz, std::size_t begin, std::size_t count, float dt)
+		{
+			for (auto i = begin; i < count; ++i)
+			{
+				px[i] += vx[i] * dt;
+				py[i] += vy[i] * dt;
+				pz[i] += vz[i] * dt;
+			}
+		}
+
+		void aabbScalar(const float *px, const float *py, const float *pz, const float *radius,
+			float *minX, float *minY, float *minZ, float *maxX, float *maxY, float *maxZ, std::size_t begin, std::size_t count)
+		{
+			for (auto i = begin; i < count; ++i)
+			{
+				minX[i] = px[i] - radius[i];
+				minY[i] = py[i] - radius[i];
+				minZ[i] = pz[i] - radius[i];
+				maxX[i] = px[i] + radius[i];
+				maxY[i] = py[i] + radius[i];
+				maxZ[i] = pz[i] + radius[i];
+			}
+		}
+
+		void cullSpheresScalar(const float *px, const float *py, const float *pz, const float *radius, std::size_t begin, std::size_t count,
+			const Plane *planes, std::size_t planeCount, std::uint8_t *visible)
+		{
+			for (auto i = begin; i < count; ++i)
+			{
+				std::uint8_t in = 1;
+				for (std::size_t p = 0; p < planeCount; ++p)
+				{
+					// Same operation order and ordered compare as the vector paths, so a
+					// sphere gets the same answer in a full register and in the tail
+					auto &pl = planes[p];
+					auto dist = (px[i] * pl.nx + py[i] * pl.ny) + (pz[i] * pl.nz + pl.d);
+					if (!(dist >= -radius[i])) in = 0;
+				}
+				visible[i] = in;
+			}
+		}
+
+		void cullDistanceScalar(const float *px, const float *py, const float *pz, std::size_t begin, std::size_t count,
+			float cx, float cy, float cz, float maxDistance, std::uint8_t *visible)
+		{
+			auto max2 = maxDistance * maxDistance;
+			for (auto i = begin; i < count; ++i)
+			{
+				auto dx = px[i] - cx, dy = py[i] - cy, dz = pz[i] - cz;
+				visible[i] = dx * dx + dy * dy + dz * dz <= max2 ? 1 : 0;
+			}
+		}
+
+#ifdef SDE_SIMD_X86
+
+		// Writes one byte (0 or 1) per lane from a compare mask
+		inline void storeMask(std::uint8_t *out, int bits, int lanes)
+		{
+			for (int l = 0; l < lanes; ++l)
+				out[l] = static_cast<std::uint8_t>((bits >> l) & 1);
+		}
+
+		SDE_TARGET("sse4.2")
+		void integrateSse(float *px, float *py, float *pz,
+			const float *vx, const float *vy, const float *vz, std::size_t count, float dt)
+		{
+			auto vdt = _mm_set1_ps(dt);
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				_mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(_mm_loadu_ps(vx + i), vdt)));
+				_mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(_mm_loadu_ps(vy + i), vdt)));
+				_mm_storeu_ps(pz + i, _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(_mm_loadu_ps(vz + i), vdt)));
+			}
+			integrateScalar(px, py, pz, vx, vy, vz, i, count, dt);
+		}
+
+		SDE_TARGET("avx2")
+		void integrateAvx(float *px, float *py, float *pz,
+			const float *vx, const float *vy, const float *vz, std::size_t count, float dt)
+		{
+			auto vdt = _mm256_set1_ps(dt);
+			std::size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				_mm256_storeu_ps(px + i, _mm256_add_ps(_mm256_loadu_ps(px + i), _mm256_mul_ps(_mm256_loadu_ps(vx + i), vdt)));
+				_mm256_storeu_ps(py + i, _mm256_add_ps(_mm256_loadu_ps(py + i), _mm256_mul_ps(_mm256_loadu_ps(vy + i), vdt)));
+				_mm256_storeu_ps(pz + i, _mm256_add_ps(_mm256_loadu_ps(pz + i), _mm256_mul_ps(_mm256_loadu_ps(vz + i), vdt)));
+			}
+			integrateScalar(px, py, pz, vx, vy, vz, i, count, dt);
+		}
+
+		SDE_TARGET("sse4.2")
+		void aabbSse(const float *px, const float *py, const float *pz, const float *radius,
+			float *minX, float *minY, float *minZ, float *maxX, float *maxY, float *maxZ, std::size_t count)
+		{
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				auto r = _mm_loadu_ps(radius + i);
+				auto x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i), z = _mm_loadu_ps(pz + i);
+				_mm_storeu_ps(minX + i, _mm_sub_ps(x, r));
+				_mm_storeu_ps(minY + i, _mm_sub_ps(y, r));
+				_mm_storeu_ps(minZ + i, _mm_sub_ps(z, r));
+				_mm_storeu_ps(maxX + i, _mm_add_ps(x, r));
+				_mm_storeu_ps(maxY + i, _mm_add_ps(y, r));
+				_mm_storeu_ps(maxZ + i, _mm_add_ps(z, r));
+			}
+			aabbScalar(px, py, pz, radius, minX, minY, minZ, maxX, maxY, maxZ, i, count);
+		}
+
+		SDE_TARGET("avx2")
+		void aabbAvx(const float *px, const float *py, const float *pz, const float *radius,
+			float *minX, float *minY, float *minZ, float *maxX, float *maxY, float *maxZ, std::size_t count)
+		{
+			std::size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				auto r = _mm256_loadu_ps(radius + i);
+				auto x = _mm256_loadu_ps(px + i), y = _mm256_loadu_ps(py + i), z = _mm256_loadu_ps(pz + i);
+				_mm256_storeu_ps(minX + i, _mm256_sub_ps(x, r));
+				_mm256_storeu_ps(minY + i, _mm256_sub_ps(y, r));
+				_mm256_storeu_ps(minZ + i, _mm256_sub_ps(z, r));
+				_mm256_storeu_ps(maxX + i, _mm256_add_ps(x, r));
+				_mm256_storeu_ps(maxY + i, _mm256_add_ps(y, r));
+				_mm256_storeu_ps(maxZ + i, _mm256_add_ps(z, r));
+			}
+			aabbScalar(px, py, pz, radius, minX, minY, minZ, maxX, maxY, maxZ, i, count);
+		}
+
+		SDE_TARGET("sse4.2")
+		void cullSpheresSse(const float *px, const float *py, const float *pz, const float *radius, std::size_t count,
+			const Plane *planes, std::size_t planeCount, std::uint8_t *visible)
+		{
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				auto x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i), z = _mm_loadu_ps(pz + i);
+				auto negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+				auto in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (std::size_t p = 0; p < planeCount; ++p)
+				{
+					auto &pl = planes[p];
+					auto dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(pl.nx)), _mm_mul_ps(y, _mm_set1_ps(pl.ny))),
+						_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(pl.nz)), _mm_set1_ps(pl.d)));
+					in = _mm_and_ps(in, _mm_cmpge_ps(dist, negR));
+				}
+				storeMask(visible + i, _mm_movemask_ps(in), 4);
+			}
+			cullSpheresScalar(px, py, pz, radius, i, count, planes, planeCount, visible);
+		}
+
+		SDE_TARGET("avx2")
+		void cullSpheresAvx(const float *px, const float *py, const float *pz, const float *radius, std::size_t count,
+			const Plane *planes, std::size_t planeCount, std::uint8_t *visible)
+		{
+			std::size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				auto x = _mm256_loadu_ps(px + i), y = _mm256_loadu_ps(py + i), z = _mm256_loadu_ps(pz + i);
+				auto negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+				auto in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (std::size_t p = 0; p < planeCount; ++p)
+				{
+					auto &pl = planes[p];
+					auto dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(pl.nx)), _mm256_mul_ps(y, _mm256_set1_ps(pl.ny))),
+						_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(pl.nz)), _mm256_set1_ps(pl.d)));
+					in = _mm256_and_ps(in, _mm256_cmp_ps(dist, negR, _CMP_GE_OQ));
+				}
+				storeMask(visible + i, _mm256_movemask_ps(in), 8);
+			}
+			cullSpheresScalar(px, py, pz, radius, i, count, planes, planeCount, visible);
+		}
+
+		SDE_TARGET("sse4.2")
+		void cullDistanceSse(const float *px, const float *py, const float *pz, std::size_t count,
+			float cx, float cy, float cz, float maxDistance, std::uint8_t *visible)
+		{
+			auto vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vcz = _mm_set1_ps(cz);
+			auto max2 = _mm_set1_ps(maxDistance * maxDistance);
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				auto dx = _mm_sub_ps(_mm_loadu_ps(px + i), vcx);
+				auto dy = _mm_sub_ps(_mm_loadu_ps(py + i), vcy);
+				auto dz = _mm_sub_ps(_mm_loadu_ps(pz + i), vcz);
+				auto d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				storeMask(visible + i, _mm_movemask_ps(_mm_cmple_ps(d2, max2)), 4);
+			}
+			cullDistanceScalar(px, py, pz, i, count, cx, cy, cz, maxDistance, visible);
+		}
+
+		SDE_TARGET("avx2")
+		void cullDistanceAvx(const float *px, const float *py, const float *pz, std::size_t count,
+			float cx, float cy, float cz, float maxDistance, std::uint8_t *visible)
+		{
+			auto vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy), vcz = _mm256_set1_ps(cz);
+			auto max2 = _mm256_set1_ps(maxDistance * maxDistance);
+			std::size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				auto dx = _mm256_sub_ps(_mm256_loadu_ps(px + i), vcx);
+				auto dy = _mm256_sub_ps(_mm256_loadu_ps(py + i), vcy);
+				auto dz = _mm256_sub_ps(_mm256_loadu_ps(pz + i), vcz);
+				auto d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				storeMask(visible + i, _mm256_movemask_ps(_mm256_cmp_ps(d2, max2, _CMP_LE_OQ)), 8);
+			}
+			cullDistanceScalar(px, py, pz, i, count, cx, cy, cz, maxDistance, visible);
+		}
+
+#endif
+
+		std::atomic<int> currentLevel{ -1 };
+	}
+
+	SimdLevel detectSimdLevel()
+	{
+#ifdef SDE_SIMD_X86
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		auto maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse42 = (info[2] & (1 << 20)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		if (avx2) return SimdLevel::Avx2;
+		if (sse42) return SimdLevel::Sse42;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+		if (__builtin_cpu_supports("sse4.2")) return SimdLevel::Sse42;
+#endif
+#endif
+		return SimdLevel::Scalar;
+	}
+
+	SimdLevel simdLevel()
+	{
+		auto level = currentLevel.load(std::memory_order_relaxed);
+		if (level < 0)
+		{
+			level = static_cast<int>(detectSimdLevel());
+			currentLevel.store(level, std::memory_order_relaxed);
+		}
+		return static_cast<SimdLevel>(level);
+	}
+
+	void setSimdLevel(SimdLevel level)
+	{
+		auto supported = detectSimdLevel();
+		if (static_cast<int>(level) > static_cast<int>(supported)) level = supported;
+		currentLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+	}
+
+	void integratePositions(float *px, float *py, float *pz,
+		const float *vx, const float *vy, const float *vz, std::size_t count, float dt)
+	{
+		switch (simdLevel())
+		{
+#ifdef SDE_SIMD_X86
+		case SimdLevel::Avx2: integrateAvx(px, py, pz, vx, vy, vz, count, dt); return;
+		case SimdLevel::Sse42: integrateSse(px, py, pz, vx, vy, vz, count, dt); return;
+#endif
+		default: integrateScalar(px, py, pz, vx, vy, vz, 0, count, dt); return;
+		}
+	}
+
+	void computeAabbs(const float *px, const float *py, const float *pz, const float *radius,
+		float *minX, float *minY, float *minZ, float *maxX, float *maxY, float *maxZ, std::size_t count)
+	{
+		switch (simdLevel())
+		{
+#ifdef SDE_SIMD_X86
+		case SimdLevel::Avx2: aabbAvx(px, py, pz, radius, minX, minY, minZ, maxX, maxY, maxZ, count); return;
+		case SimdLevel::Sse42: aabbSse(px, py, pz, radius, minX, minY, minZ, maxX, maxY, maxZ, count); return;
+#endif
+		default: aabbScalar(px, py, pz, radius, minX, minY, minZ, maxX, maxY, maxZ, 0, count); return;
+		}
+	}
+
+	void cullSpheres(const float *px, const float *py, const float *pz, const float *radius, std::size_t count,
+		const Plane *planes, std::size_t planeCount, std::uint8_t *visible)
+	{
+		switch (simdLevel())
+		{
+#ifdef SDE_SIMD_X86
+		case SimdLevel::Avx2: cullSpheresAvx(px, py, pz, radius, count, planes, planeCount, visible); return;
+		case SimdLevel::Sse42: cullSpheresSse(px, py, pz, radius, count, planes, planeCount, visible); return;
+#endif
+		default: cullSpheresScalar(px, py, pz, radius, 0, count, planes, planeCount, visible); return;
+		}
+	}
+
+	void cullDistance(const float *px, const float *py, const float *pz, std::size_t count,
+		float cx, float cy, float cz, float maxDistance, std::uint8_t *visible)
+	{
+		switch (simdLevel())
+		{
+#ifdef SDE_SIMD_X86
+		case SimdLevel::Avx2: cullDistanceAvx(px, py, pz, count, cx, cy, cz, maxDistance, visible); return;
+		case SimdLevel::Sse42: cullDistanceSse(px, py, pz, count, cx, cy, cz, maxDistance, visible); return;
+#endif
+		default: cullDistanceScalar(px, py, pz, 0, count, cx, cy, cz, maxDistance, visible); return;
+		}
+	}
+
+	void integrateBodies(SoAPool<Body> &bodies, float dt)
+	{
+		auto x = bodies.columnOf<&Body::x>();
+		// Padding lanes are scratch space, so run whole registers to the padded end
+		integratePositions(x.data, bodies.columnOf<&Body::y>().data, bodies.columnOf<&Body::z>().data,
+			bodies.columnOf<&Body::vx>().data, bodies.columnOf<&Body::vy>().data, bodies.columnOf<&Body::vz>().data,
+			x.paddedSize, dt);
+	}
+
+	void cullBodies(SoAPool<Body> &bodies, const Plane *planes, std::size_t planeCount, std::vector<std::uint8_t> &visible)
+	{
+		auto x = bodies.columnOf<&Body::x>();
+		visible.resize(x.paddedSize);
+		cullSpheres(x.data, bodies.columnOf<&Body::y>().data, bodies.columnOf<&Body::z>().data,
+			bodies.columnOf<&Body::radius>().data, x.paddedSize, planes, planeCount, visible.data());
+		visible.resize(x.size);
+	}
+}
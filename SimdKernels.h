@@ -0,0 +1,72 @@
+#pragma once
+#include "SoAPool.h"
+#include <cstdint>
+
+namespace sde
+{
+
+	/* SimdKernels - Vectorized inner loops over SoA columns. Each kernel has AVX2,
+	SSE4.2 and scalar implementations; the best one supported by the running CPU is
+	picked on first use, and setSimdLevel can force a lower one (e.g. for testing).
+	Kernels accept any count: padded columns are processed in whole registers, and
+	unpadded ones fall back to scalar code for the tail.
+	*/
+
+	enum class SimdLevel
+	{
+		Scalar,
+		Sse42,
+		Avx2
+	};
+
+	SimdLevel detectSimdLevel();
+	SimdLevel simdLevel();
+	// Clamped to what the CPU supports
+	void setSimdLevel(SimdLevel level);
+
+	// Plane with unit normal (nx, ny, nz); a point p is inside when dot(n, p) + d >= 0
+	struct Plane
+	{
+		float nx, ny, nz, d;
+	};
+
+	// p += v * dt
+	void integratePositions(float *px, float *py, float *pz,
+		const float *vx, const float *vy, const float *vz, std::size_t count, float dt);
+
+	// Axis-aligned box around each sphere (centre p, radius r)
+	void computeAabbs(const float *px, const float *py, const float *pz, const float *radius,
+		float *minX, float *minY, float *minZ, float *maxX, float *maxY, float *maxZ, std::size_t count);
+
+	// visible[i] = 1 if sphere i intersects the volume bounded by planes, else 0.
+	// A NaN in the sphere or in a plane makes it not visible, on every SIMD level.
+	void cullSpheres(const float *px, const float *py, const float *pz, const float *radius, std::size_t count,
+		const Plane *planes, std::size_t planeCount, std::uint8_t *visible);
+
+	// visible[i] = 1 if point i lies within maxDistance of (cx, cy, cz), else 0.
+	// A NaN coordinate or distance makes it not visible, on every SIMD level.
+	void cullDistance(const float *px, const float *py, const float *pz, std::size_t count,
+		float cx, float cy, float cz, float maxDistance, std::uint8_t *visible);
+
+	/* Body - Reference component for the kernels: a moving sphere. Registered for
+	SoA storage, so a SoAPool<Body> provides every column the kernels need.
+	*/
+
+	struct Body
+	{
+		float x, y, z;
+		float vx, vy, vz;
+		float radius;
+	};
+
+	template<>
+	struct SoAFields<Body>
+	{
+		static constexpr auto members = std::make_tuple(&Body::x, &Body::y, &Body::z,
+			&Body::vx, &Body::vy, &Body::vz, &Body::radius);
+	};
+
+	void integrateBodies(SoAPool<Body> &bodies, float dt);
+	// visible is resized to bodies.size(), index-aligned with bodies.entities()
+	void cullBodies(SoAPool<Body> &bodies, const Plane *planes, std::size_t planeCount, std::vector<std::uint8_t> &visible);
+}
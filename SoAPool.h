@@ -0,0 +1,313 @@
+#pragma once
+#include "EntityRegistry.h"
+#include <new>
+#include <cstring>
+#include <type_traits>
+#include <numeric>
+
+namespace sde
+{
+
+	/* SoAFields - Registration for struct-of-arrays storage. Specialize for a
+	component type and list the members to be split into columns:
+
+		template<>
+		struct SoAFields<Transform>
+		{
+			static constexpr auto members = std::make_tuple(&Transform::x, &Transform::y, &Transform::z);
+		};
+
+	Every listed member must be trivially copyable; members that are not listed
+	are not stored.
+	*/
+
+	template<typename T>
+	struct SoAFields;
+
+	// Column alignment and padding granularity, enough for AVX-512 loads
+	constexpr std::size_t soaAlignment = 64;
+
+	/* ColumnSpan - View of one SoA column. Elements [size, paddedSize) are padding:
+	they may be read and written by vector code, but hold no meaningful values.
+	*/
+
+	template<typename F>
+	struct ColumnSpan
+	{
+		F *data;
+		std::size_t size;
+		std::size_t paddedSize;
+	};
+
+	/* AlignedColumn - Growable array of trivially copyable values whose buffer is
+	aligned to soaAlignment and whose capacity is a whole number of alignment blocks.
+	The buffer comes from the memory resource given at construction.
+	*/
+
+	template<typename F>
+	class AlignedColumn
+	{
+	public:
+		static_assert(std::is_trivially_copyable<F>::value, "SoA columns hold trivially copyable fields");
+		using value_type = F;
+		// Fewest elements that fill a whole number of alignment blocks, so capacity and
+		// padded size are rounded in bytes even when sizeof(F) does not divide the
+		// alignment (16 elements of a 12-byte F fill three blocks)
+		static constexpr std::size_t lanes = soaAlignment / std::gcd(soaAlignment, sizeof(F));
+
+		explicit AlignedColumn(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_data{ nullptr }, m_size{ 0 }, m_capacity{ 0 }, m_resource{ resource }
+		{}
+		~AlignedColumn()
+		{
+			release();
+		}
+		AlignedColumn(const AlignedColumn &other) :
+			AlignedColumn(other.m_resource)
+		{
+			*this = other;
+		}
+		AlignedColumn &operator=(const AlignedColumn &other)
+		{
+			if (this == &other) return *this;
+			m_size = 0;
+			reserve(other.m_capacity);
+			if (other.m_capacity) std::memcpy(m_data, other.m_data, other.m_capacity * sizeof(F));
+			m_size = other.m_size;
+			return *this;
+		}
+
+		inline std::size_t size() const
+		{
+			return m_size;
+		}
+		inline std::size_t paddedSize() const
+		{
+			return (m_size + lanes - 1) / lanes * lanes;
+		}
+		inline std::size_t capacity() const
+		{
+			return m_capacity;
+		}
+		inline F *data()
+		{
+			return m_data;
+		}
+		inline const F *data() const
+		{
+			return m_data;
+		}
+		inline F &operator[](std::size_t i)
+		{
+			return m_data[i];
+		}
+		void reserve(std::size_t count)
+		{
+			count = (count + lanes - 1) / lanes * lanes;
+			if (count <= m_capacity) return;
+			auto np = static_cast<F *>(m_resource->allocate(count * sizeof(F), soaAlignment));
+			// Zero the whole block so padding lanes start out as harmless values
+			std::memset(static_cast<void *>(np), 0, count * sizeof(F));
+			if (m_size) std::memcpy(static_cast<void *>(np), m_data, m_size * sizeof(F));
+			release();
+			m_data = np;
+			m_capacity = count;
+		}
+		void push_back(const F &value)
+		{
+			if (m_size == m_capacity) reserve(m_capacity ? m_capacity * 2 : lanes);
+			m_data[m_size++] = value;
+		}
+		inline void pop_back()
+		{
+			--m_size;
+		}
+		void append(const F *values, std::size_t count)
+		{
+			if (m_size + count > m_capacity) reserve(std::max(m_size + count, m_capacity * 2));
+			if (count) std::memcpy(static_cast<void *>(m_data + m_size), values, count * sizeof(F));
+			m_size += count;
+		}
+	private:
+		void release()
+		{
+			if (m_data) m_resource->deallocate(m_data, m_capacity * sizeof(F), soaAlignment);
+			m_data = nullptr;
+			m_capacity = 0;
+		}
+
+		F *m_data;
+		std::size_t m_size;
+		std::size_t m_capacity;
+		std::pmr::memory_resource *m_resource;
+	};
+
+	/* SoAPool - Struct-of-arrays storage for a component type registered through
+	SoAFields. Each member lives in its own aligned, padded column, index-aligned with
+	entities(), so kernels can process whole vector registers without tail handling.
+	Attach with registry.poolOf<SoAPool<T>>(); whole components are scattered on
+	insert/set and gathered on get.
+	*/
+
+	template<typename T>
+	class SoAPool : public PoolBase
+	{
+	public:
+		using Members = std::decay_t<decltype(SoAFields<T>::members)>;
+		static constexpr std::size_t columnCount = std::tuple_size<Members>::value;
+
+		explicit SoAPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			PoolBase{ resource }, m_columns{ makeColumns(resource, std::make_index_sequence<columnCount>{}) }
+		{}
+
+		void insert(EntityId id, const T &value)
+		{
+			auto slot = findSlot(id);
+			if (slot != SparseIndex::npos)
+			{
+				scatter(slot, value, std::make_index_sequence<columnCount>{});
+				return;
+			}
+			addEntity(id);
+			pushBack(value, std::make_index_sequence<columnCount>{});
+		}
+		// Overwrites the stored fields; returns false if id has no component here
+		bool set(EntityId id, const T &value)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return false;
+			scatter(slot, value, std::make_index_sequence<columnCount>{});
+			return true;
+		}
+		// Gathers the stored fields into out; members not listed are left untouched
+		bool get(EntityId id, T &out)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return false;
+			gather(slot, out, std::make_index_sequence<columnCount>{});
+			return true;
+		}
+		void remove(EntityId id) override
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			auto last = eraseSlot(slot);
+			moveAndPop(slot, last, std::make_index_sequence<columnCount>{});
+		}
+		void reserve(std::size_t count, std::size_t indexBound) override
+		{
+			PoolBase::reserve(count, indexBound);
+			reserveColumns(count, std::make_index_sequence<columnCount>{});
+		}
+		// Columns are zeroed when allocated, so their pages are already resident
+		void memoryRanges(std::vector<MemoryRange> &out) const override
+		{
+			PoolBase::memoryRanges(out);
+			columnRanges(out, std::make_index_sequence<columnCount>{});
+		}
+
+		// Column I, in the order listed in SoAFields<T>::members
+		template<std::size_t I>
+		auto column()
+		{
+			auto &c = std::get<I>(m_columns);
+			return ColumnSpan<std::remove_reference_t<decltype(c[0])>>{ c.data(), c.size(), c.paddedSize() };
+		}
+		// Column for a registered member, e.g. columnOf<&Transform::x>()
+		template<auto Member>
+		auto columnOf()
+		{
+			static_assert(indexOf<Member>() < columnCount, "member is not registered in SoAFields");
+			return column<indexOf<Member>()>();
+		}
+
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override
+		{
+			auto pp = makeResourcePtr<SoAPool>(resource);
+			pp->copyBase(*this);
+			pp->m_columns = m_columns;
+			return pp;
+		}
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		void absorb(PoolBase &other) override
+		{
+			auto &src = static_cast<SoAPool &>(other);
+			appendEntities(src);
+			appendColumns(src, std::make_index_sequence<columnCount>{});
+		}
+
+	private:
+		template<typename M>
+		struct FieldOf;
+		template<typename F, typename C>
+		struct FieldOf<F C::*>
+		{
+			using type = F;
+		};
+		template<typename Tuple>
+		struct ColumnsOf;
+		template<typename ...Ms>
+		struct ColumnsOf<std::tuple<Ms...>>
+		{
+			using type = std::tuple<AlignedColumn<typename FieldOf<Ms>::type>...>;
+		};
+
+		template<auto Member, std::size_t I = 0>
+		static constexpr std::size_t indexOf()
+		{
+			if constexpr (std::is_same<decltype(Member), std::tuple_element_t<I, Members>>::value)
+			{
+				if (std::get<I>(SoAFields<T>::members) == Member) return I;
+			}
+			if constexpr (I + 1 < columnCount) return indexOf<Member, I + 1>();
+			else return columnCount;
+		}
+
+		template<std::size_t ...I>
+		void pushBack(const T &value, std::index_sequence<I...>)
+		{
+			(std::get<I>(m_columns).push_back(value.*std::get<I>(SoAFields<T>::members)), ...);
+		}
+		template<std::size_t ...I>
+		void scatter(std::uint32_t slot, const T &value, std::index_sequence<I...>)
+		{
+			((std::get<I>(m_columns)[slot] = value.*std::get<I>(SoAFields<T>::members)), ...);
+		}
+		template<std::size_t ...I>
+		void gather(std::uint32_t slot, T &out, std::index_sequence<I...>)
+		{
+			((out.*std::get<I>(SoAFields<T>::members) = std::get<I>(m_columns)[slot]), ...);
+		}
+		template<std::size_t ...I>
+		void moveAndPop(std::uint32_t slot, std::uint32_t last, std::index_sequence<I...>)
+		{
+			eraseFromColumns(slot, last, std::get<I>(m_columns)...);
+		}
+		template<std::size_t ...I>
+		void appendColumns(SoAPool &src, std::index_sequence<I...>)
+		{
+			auto count = src.m_entities.size();
+			(std::get<I>(m_columns).append(std::get<I>(src.m_columns).data(), count), ...);
+		}
+		template<std::size_t ...I>
+		static auto makeColumns(std::pmr::memory_resource *resource, std::index_sequence<I...>)
+		{
+			return typename ColumnsOf<Members>::type{ ((void)I, resource)... };
+		}
+		template<std::size_t ...I>
+		void reserveColumns(std::size_t count, std::index_sequence<I...>)
+		{
+			(std::get<I>(m_columns).reserve(count), ...);
+		}
+		template<std::size_t ...I>
+		void columnRanges(std::vector<MemoryRange> &out, std::index_sequence<I...>) const
+		{
+			(addMemoryRange(out, std::get<I>(m_columns)), ...);
+		}
+
+		typename ColumnsOf<Members>::type m_columns;
+	};
+}
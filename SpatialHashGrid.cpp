@@ -0,0 +1,99 @@
+#include "SpatialHashGrid.h"
+
+namespace sde
+{
+	void SpatialHashGrid::setCellSize(float size)
+	{
+		m_cellSize = size;
+		m_invCellSize = 1.0f / size;
+		m_cells.clear();
+		for (std::uint32_t slot = 0; slot < m_entities.size(); ++slot)
+		{
+			if (m_cellPos[slot] == unbucketed) continue;
+			bucket(slot);
+		}
+	}
+
+	ResourcePtr<PoolBase> SpatialHashGrid::clone(std::pmr::memory_resource *resource) const
+	{
+		auto pp = makeResourcePtr<SpatialHashGrid>(resource);
+		pp->copyBase(*this);
+		pp->m_cellSize = m_cellSize;
+		pp->m_invCellSize = m_invCellSize;
+		pp->m_cells = m_cells;
+		pp->m_pos = m_pos;
+		pp->m_cell = m_cell;
+		pp->m_cellPos = m_cellPos;
+		return pp;
+	}
+
+	void SpatialHashGrid::absorb(PoolBase &other)
+	{
+		auto &src = static_cast<SpatialHashGrid &>(other);
+		for (std::size_t slot = 0; slot < src.m_entities.size(); ++slot)
+		{
+			auto &p = src.m_pos[slot];
+			update(src.m_entities[slot], p.x, p.y, p.z, src.m_cellPos[slot] != unbucketed);
+		}
+	}
+
+	void SpatialHashGrid::update(EntityId id, float x, float y, float z, bool active)
+	{
+		auto slot = findSlot(id);
+		if (slot == SparseIndex::npos)
+		{
+			slot = addEntity(id);
+			m_pos.push_back(Position{ x, y, z });
+			m_cell.push_back(0);
+			m_cellPos.push_back(unbucketed);
+			if (active) bucket(slot);
+			return;
+		}
+		m_pos[slot] = Position{ x, y, z };
+		if (m_cellPos[slot] == unbucketed) return;
+		if (packKey(cellCoord(x), cellCoord(y), cellCoord(z)) == m_cell[slot]) return;
+		unbucket(slot);
+		bucket(slot);
+	}
+
+	void SpatialHashGrid::remove(EntityId id)
+	{
+		auto slot = findSlot(id);
+		if (slot == SparseIndex::npos) return;
+		if (m_cellPos[slot] != unbucketed) unbucket(slot);
+		auto last = eraseSlot(slot);
+		eraseFromColumns(slot, last, m_pos, m_cell, m_cellPos);
+		// The moved entity's bucket entry follows it
+		if (slot != last && m_cellPos[slot] != unbucketed) m_cells[m_cell[slot]][m_cellPos[slot]] = slot;
+	}
+
+	void SpatialHashGrid::onActiveChanged(EntityId id, bool b)
+	{
+		auto slot = findSlot(id);
+		if (slot == SparseIndex::npos) return;
+		if (b && m_cellPos[slot] == unbucketed) bucket(slot);
+		else if (!b && m_cellPos[slot] != unbucketed) unbucket(slot);
+	}
+
+	void SpatialHashGrid::bucket(std::uint32_t slot)
+	{
+		auto &p = m_pos[slot];
+		auto key = packKey(cellCoord(p.x), cellCoord(p.y), cellCoord(p.z));
+		auto &members = m_cells[key];
+		m_cell[slot] = key;
+		m_cellPos[slot] = static_cast<std::uint32_t>(members.size());
+		members.push_back(slot);
+	}
+
+	void SpatialHashGrid::unbucket(std::uint32_t slot)
+	{
+		auto it = m_cells.find(m_cell[slot]);
+		auto &members = it->second;
+		auto pos = m_cellPos[slot];
+		members[pos] = members.back();
+		m_cellPos[members[pos]] = pos;
+		members.pop_back();
+		if (members.empty()) m_cells.erase(it);
+		m_cellPos[slot] = unbucketed;
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include "EntityRegistry.h"
+#include <cmath>
+
+namespace sde
+{
+
+	/* SpatialHashGrid - Uniform hash grid over entity positions for proximity
+	queries. Positions are pushed in with update() whenever they change, and only a
+	change of cell touches the buckets. For 2D use, pass z = 0.
+
+	Attach with registry.poolOf<SpatialHashGrid>() and call setCellSize before use;
+	destroyed entities are dropped and deactivated entities are taken out of the
+	buckets until they are reactivated, so queries only see live, active entities
+	(an entity that is already inactive when first added needs update's active
+	argument). Cell size should be close to the typical query radius.
+	*/
+
+	class SpatialHashGrid : public PoolBase
+	{
+	public:
+		explicit SpatialHashGrid(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			PoolBase{ resource }, m_cellSize{ 1.0f }, m_invCellSize{ 1.0f }, m_cells{ resource },
+			m_pos{ resource }, m_cell{ resource }, m_cellPos{ resource }
+		{}
+
+		// Rebuckets every entity
+		void setCellSize(float size);
+		inline float cellSize() const
+		{
+			return m_cellSize;
+		}
+
+		// active only matters when id is new to the grid: the registry reports later
+		// changes, but not the state id already had, so pass registry.active(id) when
+		// the entity may be inactive
+		void update(EntityId id, float x, float y, float z = 0.0f, bool active = true);
+		void remove(EntityId id) override;
+		void onActiveChanged(EntityId id, bool b) override;
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override;
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		// Rebuckets the staged positions with this grid's cell size
+		void absorb(PoolBase &other) override;
+
+		// f(EntityId) for every entity within r of (x, y, z)
+		template<typename F>
+		void queryRadius(float x, float y, float z, float r, F f) const
+		{
+			auto r2 = r * r;
+			queryCells(x - r, y - r, z - r, x + r, y + r, z + r, [&](std::uint32_t slot)
+			{
+				auto &p = m_pos[slot];
+				auto dx = p.x - x, dy = p.y - y, dz = p.z - z;
+				if (dx * dx + dy * dy + dz * dz <= r2) f(m_entities[slot]);
+			});
+		}
+		// f(EntityId) for every entity inside the box [min, max]
+		template<typename F>
+		void queryAabb(float minX, float minY, float minZ, float maxX, float maxY, float maxZ, F f) const
+		{
+			queryCells(minX, minY, minZ, maxX, maxY, maxZ, [&](std::uint32_t slot)
+			{
+				auto &p = m_pos[slot];
+				if (p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY && p.z >= minZ && p.z <= maxZ)
+					f(m_entities[slot]);
+			});
+		}
+		// f(EntityId, EntityId) once for every unordered pair closer than r
+		template<typename F>
+		void forEachPair(float r, F f) const
+		{
+			auto r2 = r * r;
+			auto reach = static_cast<int>(std::ceil(r * m_invCellSize));
+			auto test = [&](std::uint32_t a, std::uint32_t b)
+			{
+				auto dx = m_pos[a].x - m_pos[b].x, dy = m_pos[a].y - m_pos[b].y, dz = m_pos[a].z - m_pos[b].z;
+				if (dx * dx + dy * dy + dz * dz <= r2) f(m_entities[a], m_entities[b]);
+			};
+			for (auto &cell : m_cells)
+			{
+				auto &members = cell.second;
+				for (std::size_t i = 0; i < members.size(); ++i)
+				{
+					for (std::size_t j = i + 1; j < members.size(); ++j)
+						test(members[i], members[j]);
+				}
+				int cx, cy, cz;
+				unpackKey(cell.first, cx, cy, cz);
+				// Visit only the "forward" half of the neighbourhood so each pair of cells is seen once
+				for (int dx = -reach; dx <= reach; ++dx)
+				{
+					for (int dy = -reach; dy <= reach; ++dy)
+					{
+						for (int dz = -reach; dz <= reach; ++dz)
+						{
+							if (dx < 0 || (dx == 0 && (dy < 0 || (dy == 0 && dz <= 0)))) continue;
+							auto it = m_cells.find(packKey(cx + dx, cy + dy, cz + dz));
+							if (it == std::end(m_cells)) continue;
+							for (auto a : members)
+							{
+								for (auto b : it->second)
+									test(a, b);
+							}
+						}
+					}
+				}
+			}
+		}
+
+	private:
+		struct Position
+		{
+			float x, y, z;
+		};
+		static constexpr std::uint32_t unbucketed = 0xffffffffu;
+
+		inline int cellCoord(float v) const
+		{
+			return static_cast<int>(std::floor(v * m_invCellSize));
+		}
+		static inline std::uint64_t packKey(int x, int y, int z)
+		{
+			auto mask = std::uint64_t{ 0x1fffff };
+			return ((static_cast<std::uint64_t>(x) & mask) << 42) | ((static_cast<std::uint64_t>(y) & mask) << 21) | (static_cast<std::uint64_t>(z) & mask);
+		}
+		static inline void unpackKey(std::uint64_t key, int &x, int &y, int &z)
+		{
+			// Sign-extend each 21-bit field
+			auto field = [](std::uint64_t v)
+			{
+				return static_cast<int>(static_cast<std::int32_t>(static_cast<std::uint32_t>(v << 11)) >> 11);
+			};
+			x = field((key >> 42) & 0x1fffff);
+			y = field((key >> 21) & 0x1fffff);
+			z = field(key & 0x1fffff);
+		}
+		template<typename F>
+		void queryCells(float minX, float minY, float minZ, float maxX, float maxY, float maxZ, F f) const
+		{
+			auto x0 = cellCoord(minX), x1 = cellCoord(maxX);
+			auto y0 = cellCoord(minY), y1 = cellCoord(maxY);
+			auto z0 = cellCoord(minZ), z1 = cellCoord(maxZ);
+			for (auto cx = x0; cx <= x1; ++cx)
+			{
+				for (auto cy = y0; cy <= y1; ++cy)
+				{
+					for (auto cz = z0; cz <= z1; ++cz)
+					{
+						auto it = m_cells.find(packKey(cx, cy, cz));
+						if (it == std::end(m_cells)) continue;
+						for (auto slot : it->second)
+							f(slot);
+					}
+				}
+			}
+		}
+		void bucket(std::uint32_t slot);
+		void unbucket(std::uint32_t slot);
+
+		float m_cellSize;
+		float m_invCellSize;
+		std::pmr::unordered_map<std::uint64_t, std::pmr::vector<std::uint32_t>> m_cells;
+		// Per dense slot
+		std::pmr::vector<Position> m_pos;
+		std::pmr::vector<std::uint64_t> m_cell;
+		std::pmr::vector<std::uint32_t> m_cellPos;
+	};
+}
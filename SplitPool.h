@@ -0,0 +1,161 @@
+#pragma once
+#include "EntityRegistry.h"
+
+namespace sde
+{
+
+	/* SplitPool - Hot/cold split storage. A component declares its parts as nested
+	types:
+
+		struct Unit
+		{
+			struct Hot { float x, y, speed; };
+			struct Cold { std::string debugName; std::uint32_t spawnTick; };
+		};
+
+	Hot parts are packed in one array and cold parts in a parallel side array at the
+	same index, so per-frame iteration over hot data never pulls cold bytes into
+	cache. Access counters record how often each part is actually touched, to check
+	that the split matches real usage. Attach with registry.poolOf<SplitPool<T>>().
+	*/
+
+	template<typename T>
+	class SplitPool : public PoolBase
+	{
+	public:
+		using Hot = typename T::Hot;
+		using Cold = typename T::Cold;
+
+		struct AccessCounters
+		{
+			std::uint64_t hot;
+			std::uint64_t cold;
+		};
+
+		explicit SplitPool(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			PoolBase{ resource }, m_hot{ resource }, m_cold{ resource }, m_counters{ 0, 0 }
+		{}
+
+		void emplace(EntityId id, const Hot &hotPart, const Cold &coldPart = Cold{})
+		{
+			auto slot = findSlot(id);
+			if (slot != SparseIndex::npos)
+			{
+				m_hot[slot] = hotPart;
+				m_cold[slot] = coldPart;
+				return;
+			}
+			addEntity(id);
+			m_hot.push_back(hotPart);
+			m_cold.push_back(coldPart);
+		}
+		void remove(EntityId id) override
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return;
+			auto last = eraseSlot(slot);
+			eraseFromColumns(slot, last, m_hot, m_cold);
+		}
+
+		inline Hot *hot(EntityId id)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return nullptr;
+			++m_counters.hot;
+			return &m_hot[slot];
+		}
+		inline Cold *cold(EntityId id)
+		{
+			auto slot = findSlot(id);
+			if (slot == SparseIndex::npos) return nullptr;
+			++m_counters.cold;
+			return &m_cold[slot];
+		}
+		// Whole-array access counts every element as touched once
+		inline Hot *hotData()
+		{
+			m_counters.hot += m_hot.size();
+			return m_hot.data();
+		}
+		inline Cold *coldData()
+		{
+			m_counters.cold += m_cold.size();
+			return m_cold.data();
+		}
+		// f(EntityId, Hot &)
+		template<typename F>
+		void eachHot(F f)
+		{
+			m_counters.hot += m_hot.size();
+			for (std::size_t i = 0; i < m_hot.size(); ++i)
+				f(m_entities[i], m_hot[i]);
+		}
+		// f(EntityId, Hot &, Cold &)
+		template<typename F>
+		void each(F f)
+		{
+			m_counters.hot += m_hot.size();
+			m_counters.cold += m_cold.size();
+			for (std::size_t i = 0; i < m_hot.size(); ++i)
+				f(m_entities[i], m_hot[i], m_cold[i]);
+		}
+
+		inline const AccessCounters &counters() const
+		{
+			return m_counters;
+		}
+		inline void resetCounters()
+		{
+			m_counters = AccessCounters{ 0, 0 };
+		}
+
+		void reserve(std::size_t count, std::size_t indexBound) override
+		{
+			PoolBase::reserve(count, indexBound);
+			m_hot.reserve(count);
+			m_cold.reserve(count);
+		}
+		void prefault() override
+		{
+			PoolBase::prefault();
+			touchCapacity(m_hot);
+			touchCapacity(m_cold);
+		}
+		// Memory the cold parts own themselves, such as string buffers, is not included
+		void memoryRanges(std::vector<MemoryRange> &out) const override
+		{
+			PoolBase::memoryRanges(out);
+			addMemoryRange(out, m_hot);
+			addMemoryRange(out, m_cold);
+		}
+
+		ResourcePtr<PoolBase> clone(std::pmr::memory_resource *resource) const override
+		{
+			if constexpr (std::is_copy_constructible<Hot>::value && std::is_copy_constructible<Cold>::value)
+			{
+				auto pp = makeResourcePtr<SplitPool>(resource);
+				pp->copyBase(*this);
+				pp->m_hot = m_hot;
+				pp->m_cold = m_cold;
+				return pp;
+			}
+			else return nullptr;
+		}
+		bool canAbsorb() const override
+		{
+			return true;
+		}
+		void absorb(PoolBase &other) override
+		{
+			auto &src = static_cast<SplitPool &>(other);
+			appendEntities(src);
+			m_hot.insert(std::end(m_hot), std::begin(src.m_hot), std::end(src.m_hot));
+			m_cold.insert(std::end(m_cold), std::make_move_iterator(std::begin(src.m_cold)), std::make_move_iterator(std::end(src.m_cold)));
+		}
+
+	private:
+		std::pmr::vector<Hot> m_hot;
+		std::pmr::vector<Cold> m_cold;
+		AccessCounters m_counters;
+	};
+}
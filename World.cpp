@@ -0,0 +1,86 @@
+#include "World.h"
+#include <atomic>
+
+namespace sde
+{
+	std::size_t nextEventTypeId()
+	{
+		static std::atomic<std::size_t> next{ 0 };
+		return next++;
+	}
+
+	void EventBus::add(std::size_t tid, Handler h)
+	{
+		if (m_publishing)
+		{
+			m_pending.emplace_back(tid, std::move(h));
+			return;
+		}
+		if (tid >= m_handlers.size()) m_handlers.resize(tid + 1);
+		m_handlers[tid].push_back(std::move(h));
+	}
+
+	void EventBus::unsubscribe(SubscriptionId id)
+	{
+		auto pp = std::find_if(std::begin(m_pending), std::end(m_pending), [id](const std::pair<std::size_t, Handler> &p)
+		{
+			return p.second.id == id;
+		});
+		if (pp != std::end(m_pending))
+		{
+			m_pending.erase(pp);
+			return;
+		}
+		for (auto &handlers : m_handlers)
+		{
+			auto it = std::find_if(std::begin(handlers), std::end(handlers), [id](const Handler &h)
+			{
+				return h.id == id;
+			});
+			if (it == std::end(handlers)) continue;
+			if (m_publishing)
+			{
+				it->id = 0;
+				m_tombstones = true;
+			}
+			else handlers.erase(it);
+			return;
+		}
+	}
+
+	void EventBus::settle()
+	{
+		if (m_tombstones)
+		{
+			for (auto &handlers : m_handlers)
+			{
+				handlers.erase(std::remove_if(std::begin(handlers), std::end(handlers), [](const Handler &h)
+				{
+					return h.id == 0;
+				}), std::end(handlers));
+			}
+			m_tombstones = false;
+		}
+		for (auto &p : m_pending)
+		{
+			if (p.first >= m_handlers.size()) m_handlers.resize(p.first + 1);
+			m_handlers[p.first].push_back(std::move(p.second));
+		}
+		m_pending.clear();
+	}
+
+	World::World(std::pmr::memory_resource *resource) :
+		World(std::make_unique<EntityRegistry>(resource), resource)
+	{}
+
+	World::World(std::unique_ptr<EntityRegistry> registry, std::pmr::memory_resource *resource) :
+		m_registry{ std::move(registry) }, m_events{ resource }
+	{}
+
+	std::unique_ptr<World> World::clone(std::pmr::memory_resource *resource) const
+	{
+		auto rp = m_registry->clone(resource);
+		if (!rp) return nullptr;
+		return std::unique_ptr<World>(new World(std::move(rp), resource));
+	}
+}
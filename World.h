@@ -0,0 +1,132 @@
+#pragma once
+#include "EntityRegistry.h"
+
+namespace sde
+{
+
+	/* eventTypeId - Small dense integer per event type, indexing EventBus handler
+	lists. Counted apart from componentTypeId so events do not take up pool table slots.
+	*/
+
+	std::size_t nextEventTypeId();
+
+	template<typename ET>
+	std::size_t eventTypeId()
+	{
+		static const std::size_t id = nextEventTypeId();
+		return id;
+	}
+
+	/* EventBus - Event dispatch owned by one World, instead of the process-wide
+	receiver lists behind EventHandler. Handlers are plain callables subscribed per
+	event type; publish calls them in subscription order. Subscribing and
+	unsubscribing from inside a handler is allowed and takes effect once the
+	outermost publish returns.
+	*/
+
+	class EventBus
+	{
+	public:
+		using SubscriptionId = std::uint64_t;
+
+		explicit EventBus(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_handlers{ resource }, m_pending{ resource }, m_nextId{ 1 }, m_publishing{ 0 }, m_tombstones{ false }
+		{}
+		EventBus(const EventBus &other) = delete;
+		EventBus &operator=(const EventBus &other) = delete;
+
+		template<typename ET>
+		SubscriptionId subscribe(std::function<void(const ET &)> f)
+		{
+			auto id = m_nextId++;
+			add(eventTypeId<ET>(), Handler{ id, [f](const void *evnt)
+			{
+				f(*static_cast<const ET *>(evnt));
+			} });
+			return id;
+		}
+		void unsubscribe(SubscriptionId id);
+		template<typename ET>
+		void publish(const ET &evnt)
+		{
+			auto tid = eventTypeId<ET>();
+			if (tid >= m_handlers.size()) return;
+			PublishGuard guard{ *this };
+			for (auto &h : m_handlers[tid])
+			{
+				if (h.id) h.call(&evnt);
+			}
+		}
+	private:
+		// Ends a publish also when a handler throws, so the bus does not stay stuck
+		// deferring subscription changes
+		class PublishGuard
+		{
+		public:
+			explicit PublishGuard(EventBus &bus) :
+				m_bus(bus)
+			{
+				++m_bus.m_publishing;
+			}
+			~PublishGuard()
+			{
+				if (--m_bus.m_publishing == 0) m_bus.settle();
+			}
+			PublishGuard(const PublishGuard &other) = delete;
+			PublishGuard &operator=(const PublishGuard &other) = delete;
+		private:
+			EventBus &m_bus;
+		};
+
+		struct Handler
+		{
+			// 0 once unsubscribed during a publish
+			SubscriptionId id;
+			std::function<void(const void *)> call;
+		};
+
+		void add(std::size_t tid, Handler h);
+		// Applies subscription changes made while publishing
+		void settle();
+
+		std::pmr::vector<std::pmr::vector<Handler>> m_handlers;
+		std::pmr::vector<std::pair<std::size_t, Handler>> m_pending;
+		SubscriptionId m_nextId;
+		std::size_t m_publishing;
+		bool m_tombstones;
+	};
+
+	/* World - One self-contained simulation: an EntityRegistry and its EventBus.
+	Worlds share no mutable state, so separate worlds can be stepped on separate
+	threads. clone() forks a world for speculative simulation: the copy is
+	independent and can be stepped ahead and discarded.
+	*/
+
+	class World
+	{
+	public:
+		explicit World(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+		World(const World &other) = delete;
+		World &operator=(const World &other) = delete;
+
+		inline EntityRegistry &registry()
+		{
+			return *m_registry;
+		}
+		inline EventBus &events()
+		{
+			return m_events;
+		}
+
+		// Copies every pool in bulk. Subscriptions are not copied, because handlers
+		// usually refer to systems of the original world; the clone's bus starts empty.
+		// Returns nullptr if the registry cannot be cloned, see EntityRegistry::clone.
+		std::unique_ptr<World> clone(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+	private:
+		World(std::unique_ptr<EntityRegistry> registry, std::pmr::memory_resource *resource);
+
+		std::unique_ptr<EntityRegistry> m_registry;
+		EventBus m_events;
+	};
+}
@@ -5,6 +5,16 @@
 #include <typeindex>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <new>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <type_traits>
+#include "Epoch.h"
 
 namespace sde
 {
@@ -48,6 +58,11 @@ namespace sde
 		MFunc<T, ET> m_func;
 	};
 
+	/* EventHandler - Base class for anything that receives events. The function table
+	is kept in a side structure that is only allocated on the first registerFunc, so
+	handlers that never subscribe (most components) carry a single null pointer.
+	*/
+
 	class EventHandler
 	{
 	public:
@@ -56,14 +71,74 @@ namespace sde
 		void registerFunc(T *caller, MFunc<T, ET> func)
 		{
 			std::type_index ti{ typeid(ET) };
-			m_funcMap[ti] = std::make_shared<FuncWrapper<T, ET>>(caller, func);
+			if (!m_events) createEventState(std::pmr::get_default_resource());
+			auto &funcMap = m_events->funcMap;
+			auto it = std::find_if(std::begin(funcMap), std::end(funcMap), [&](const FuncEntry &e)
+			{
+				return e.first == ti;
+			});
+			auto fp = std::allocate_shared<FuncWrapper<T, ET>>(funcMap.get_allocator(), caller, func);
+			if (it != std::end(funcMap))
+			{
+				it->second = fp;
+				return;
+			}
+			funcMap.emplace_back(ti, fp);
 			m_receiverMap[ti].emplace_back(caller);
 		}
 		void handleEvent(EventBase *evnt);
 		void broadcast(EventBase *evnt);
+		// Takes this handler out of the receiver lists, as the destructor does
+		void unregisterReceivers();
+
+		// Capacity reservation, so subscribing during load does not reallocate later
+
+		// Room for n receivers of event type ET
+		template<typename ET>
+		static void reserveReceivers(std::size_t n)
+		{
+			m_receiverMap[std::type_index{ typeid(ET) }].reserve(n);
+		}
+		// Room for n distinct event types in this handler's function table. The first
+		// call also decides where the table lives; otherwise it is allocated from the
+		// default resource on the first registerFunc.
+		void reserveEvents(std::size_t n, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+		// Receiver snapshots for other threads, published from the thread that
+		// registers handlers. A handler must leave the receiver lists before it is
+		// handed to the domain for deletion, and the lists must be republished in
+		// between: then only snapshots older than the removal list it, and the epoch
+		// keeps it alive for their readers. BasicEntity::retire and publish follow
+		// this order for an entity and its components.
+
+		static void publishReceivers(EpochDomain &domain = defaultEpochDomain());
+		// Receivers of ET as of the last publish, or nullptr; valid while a
+		// ReadGuard on the publishing domain is held
+		template<typename ET>
+		static const std::vector<EventHandler *> *publishedReceivers()
+		{
+			auto snapshot = m_publishedReceivers.get();
+			if (!snapshot) return nullptr;
+			auto p = snapshot->find(std::type_index{ typeid(ET) });
+			return p == std::end(*snapshot) ? nullptr : &p->second;
+		}
 	private:
-		std::map<std::type_index, std::shared_ptr<IFuncWrapper>> m_funcMap;
+		using FuncEntry = std::pair<std::type_index, std::shared_ptr<IFuncWrapper>>;
+		struct EventState
+		{
+			// Handlers subscribe to a handful of event types, so a flat table beats a map
+			std::pmr::vector<FuncEntry> funcMap;
+		};
+		// Returns the state to the memory resource it came from
+		struct EventStateDeleter
+		{
+			void operator()(EventState *state) const;
+		};
+		void createEventState(std::pmr::memory_resource *resource);
+
+		std::unique_ptr<EventState, EventStateDeleter> m_events;
 		static std::map<std::type_index, std::vector<EventHandler *>> m_receiverMap;
+		static Published<std::map<std::type_index, std::vector<EventHandler *>>> m_publishedReceivers;
 	};
 
 	/* ISystem - Interface class for simulation systems.
@@ -75,10 +150,27 @@ namespace sde
 		virtual void execute() = 0;
 	};
 
-	/* ComponentBase - Base class for Components to be held by Entities.
+	/* Entity - Default BasicEntity configuration for components derived from
+	ComponentBase. Declared here so components can refer to their parent.
 	*/
 
-	class Entity;
+	template<typename ComponentBaseT>
+	class VectorComponentStorage;
+	class VectorTags;
+	template<typename ComponentBaseT>
+	class MapActivity;
+
+	template<typename ComponentBaseT,
+		typename StoragePolicy = VectorComponentStorage<ComponentBaseT>,
+		typename TagPolicy = VectorTags,
+		typename ActivityPolicy = MapActivity<ComponentBaseT>>
+	class BasicEntity;
+
+	class ComponentBase;
+	using Entity = BasicEntity<ComponentBase>;
+
+	/* ComponentBase - Base class for Components to be held by Entities.
+	*/
 
 	class ComponentBase : public EventHandler
 	{
@@ -138,6 +230,12 @@ namespace sde
 	/* AutoList - A base class template to simplify iteration through
 	objects of the same type by allowing them to add a reference
 	to a static vector at construction time.
+
+	The list belongs to one thread. Other threads read the copy made by the last
+	publish() through snapshot() while holding an EpochDomain::ReadGuard. Objects
+	that may appear in a snapshot are destroyed with retire() instead of delete,
+	which takes them out of the list at once and deletes them once no reader can
+	hold them; call collect() on the domain from the owning thread.
 	*/
 
 	template<typename T>
@@ -162,158 +260,428 @@ namespace sde
 		{
 			return m_ref[index];
 		}
+		static void reserve(std::size_t n)
+		{
+			m_ref.reserve(n);
+		}
+
+		// Concurrent reading
+
+		// The list as of the last publish()
+		static const std::vector<T *> &snapshot()
+		{
+			static const std::vector<T *> empty;
+			auto p = m_published.get();
+			return p ? *p : empty;
+		}
+		static void publish(EpochDomain &domain = defaultEpochDomain())
+		{
+			m_published.publish(std::make_unique<const std::vector<T *>>(m_ref), domain);
+			for (auto p : m_retiring)
+				domain.retire(p);
+			m_retiring.clear();
+		}
+		static void retire(T *p)
+		{
+			auto it = std::find(std::begin(m_ref), std::end(m_ref), p);
+			if (it != std::end(m_ref)) m_ref.erase(it);
+			m_retiring.push_back(p);
+		}
 	private:
 		static std::vector<T *> m_ref;
+		static Published<std::vector<T *>> m_published;
+		// Retired since the last publish, still listed in the current snapshot
+		static std::vector<T *> m_retiring;
 	};
 
 	template<typename T>
 	std::vector<T *> AutoList<T>::m_ref;
+	template<typename T>
+	Published<std::vector<T *>> AutoList<T>::m_published;
+	template<typename T>
+	std::vector<T *> AutoList<T>::m_retiring;
+
+	/* initializeByType - Runs initialize() on a batch of pending components grouped
+	by concrete type, so each type's initialize() is called over a contiguous run instead
+	of interleaving unrelated virtual calls. Groups are visited in order of first appearance.
+	When parallel is true, distinct types are initialized concurrently on a small pool of
+	worker threads, so initialize() of different types must not touch shared state
+	(note that registerFunc is not thread safe).
+	*/
+
+	template<typename T>
+	void initializeByType(const std::vector<T *> &pending, bool parallel)
+	{
+		std::unordered_map<std::type_index, std::size_t> groupIndex;
+		std::vector<std::vector<T *>> groups;
 
-	/* Entity - Basic Component-holding class. Components should be
-	worked on by systems inheriting from ISystem.
+		for (auto cp : pending)
+		{
+			if (!cp) continue;
+			std::type_index ti{ typeid(*cp) };
+			auto it = groupIndex.find(ti);
+			if (it == std::end(groupIndex))
+			{
+				it = groupIndex.emplace(ti, groups.size()).first;
+				groups.emplace_back();
+			}
+			groups[it->second].push_back(cp);
+		}
+
+		auto runGroup = [&](std::size_t i)
+		{
+			for (auto cp : groups[i])
+				cp->initialize();
+		};
+
+		std::size_t workerCount = std::min<std::size_t>(groups.size(), std::thread::hardware_concurrency());
+		if (!parallel || workerCount < 2)
+		{
+			for (std::size_t i = 0; i < groups.size(); ++i)
+				runGroup(i);
+			return;
+		}
+
+		std::atomic<std::size_t> next{ 0 };
+		auto worker = [&]
+		{
+			for (std::size_t i = next++; i < groups.size(); i = next++)
+				runGroup(i);
+		};
+		std::vector<std::future<void>> jobs;
+		for (std::size_t i = 1; i < workerCount; ++i)
+			jobs.push_back(std::async(std::launch::async, worker));
+		worker();
+		for (auto &job : jobs)
+			job.get();
+	}
+
+	/* Component storage policies - Own an entity's components and expose them by
+	index. Must provide emplace<T>(args...), size(), at(i) and erase(i).
+
+	Policies that allocate take a std::pmr::memory_resource * in their constructor;
+	BasicEntity passes the one it was constructed with.
+
+	VectorComponentStorage - Default policy: each component is allocated on its own
+	from the entity's memory resource.
 	*/
 
-	class Entity : public AutoList<Entity>, public EventHandler
+	template<typename ComponentBaseT>
+	class VectorComponentStorage
 	{
 	public:
-		Entity() :
-			m_active{ true }
-		{}
-		virtual ~Entity()
+		explicit VectorComponentStorage(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_component{ resource }
 		{}
-		Entity(const Entity &other) = delete;
-		Entity(Entity &&other) = delete;
-		Entity &operator=(const Entity &other) = delete;
-		Entity &operator=(Entity &&other) = delete;
+		~VectorComponentStorage()
+		{
+			for (auto &slot : m_component)
+				destroy(slot);
+		}
+		VectorComponentStorage(const VectorComponentStorage &other) = delete;
+		VectorComponentStorage &operator=(const VectorComponentStorage &other) = delete;
 
-		inline void setActive(bool b)
+		template<typename T, typename ...Args>
+		T *emplace(const Args &...args)
 		{
-			m_active = b;
-			// Set / restore prior active state for components
-			if (m_active)
+			auto resource = m_component.get_allocator().resource();
+			auto mem = resource->allocate(sizeof(T), alignof(T));
+			T *cp;
+			try
 			{
-				for (auto &pair : m_compActiveMap)
-				{
-					pair.first->setActive(pair.second);
-				}
+				cp = new (mem) T(args...);
+				m_component.push_back(Slot{ cp, static_cast<std::uint32_t>(sizeof(T)), static_cast<std::uint32_t>(alignof(T)) });
 			}
-			else
+			catch (...)
 			{
-				for (auto &up : m_component)
-				{
-					m_compActiveMap[up.get()] = up->active();
-					up->setActive(false);
-				}
+				resource->deallocate(mem, sizeof(T), alignof(T));
+				throw;
 			}
+			return cp;
 		}
-		inline bool active() const
+		inline std::size_t size() const
 		{
-			return m_active;
+			return m_component.size();
 		}
-
-		// Component management
-
-		template<typename T, typename ...Args>
-		void addComponent(const Args &...args)
+		inline ComponentBaseT *at(std::size_t i) const
 		{
-			m_component.push_back(std::make_unique<T>(args...));
+			return m_component[i].ptr;
 		}
-		template<typename T>
-		T *getComponent() const
+		inline void erase(std::size_t i)
 		{
-			std::type_index ti{ typeid(T) };
+			destroy(m_component[i]);
+			m_component.erase(std::begin(m_component) + i);
+		}
+	private:
+		struct Slot
+		{
+			ComponentBaseT *ptr;
+			std::uint32_t size;
+			std::uint32_t align;
+		};
+		void destroy(Slot &slot)
+		{
+			// Components are polymorphic, so this finds the start of the allocation
+			auto mem = dynamic_cast<void *>(slot.ptr);
+			slot.ptr->~ComponentBaseT();
+			m_component.get_allocator().resource()->deallocate(mem, slot.size, slot.align);
+		}
 
-			auto it = std::find_if(std::begin(m_component), std::end(m_component), [&](const std::unique_ptr<ComponentBase> &up)
-			{
-				return std::type_index{ typeid(*up.get()) } == ti;
-			});
+		std::pmr::vector<Slot> m_component;
+	};
 
-			if (it != std::end(m_component)) return static_cast<T *>(it->get());
-			return nullptr;
-		}
-		template<typename T>
-		std::vector<T *> getComponents()
+	/* InlineComponentStorage - Small-vector policy. The first N component pointers
+	live inside the entity and only further ones spill to a list allocated from the
+	entity's memory resource. When InlineBytes is non-zero, components that fit are
+	also constructed in an inline buffer, so an entity with a few small components
+	needs no allocation at all; the others come from the resource as well. Inline
+	space is bump allocated and reclaimed once every inline component has been
+	removed. Entities never move, so inline components keep stable addresses.
+	*/
+
+	template<typename ComponentBaseT, std::size_t N, std::size_t InlineBytes = 0>
+	class InlineComponentStorage
+	{
+	public:
+		explicit InlineComponentStorage(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_spill{ resource }, m_size{ 0 }, m_used{ 0 }, m_inlineCount{ 0 }
+		{}
+		~InlineComponentStorage()
 		{
-			std::vector<T *> r;
-			std::type_index ti{ typeid(T) };
+			for (std::size_t i = 0; i < m_size; ++i)
+				destroy(slot(i));
+		}
+		InlineComponentStorage(const InlineComponentStorage &other) = delete;
+		InlineComponentStorage &operator=(const InlineComponentStorage &other) = delete;
 
-			for (auto &up : m_component)
+		template<typename T, typename ...Args>
+		T *emplace(const Args &...args)
+		{
+			auto mem = allocateInline(sizeof(T), alignof(T));
+			if (mem)
 			{
-				if (std::type_index{ typeid(*up.get()) } == ti) r.push_back(static_cast<T *>(up.get()));
+				auto cp = new (mem) T(args...);
+				// Inline components are recognized by address and need no size
+				add(Slot{ cp, 0, 0 });
+				++m_inlineCount;
+				return cp;
 			}
-			return r;
+			auto resource = m_spill.get_allocator().resource();
+			mem = resource->allocate(sizeof(T), alignof(T));
+			T *cp;
+			try
+			{
+				cp = new (mem) T(args...);
+				add(Slot{ cp, static_cast<std::uint32_t>(sizeof(T)), static_cast<std::uint32_t>(alignof(T)) });
+			}
+			catch (...)
+			{
+				resource->deallocate(mem, sizeof(T), alignof(T));
+				throw;
+			}
+			return cp;
 		}
-		template<typename T>
-		void removeComponent()
+		inline std::size_t size() const
 		{
-			std::type_index ti{ typeid(T) };
+			return m_size;
+		}
+		inline ComponentBaseT *at(std::size_t i) const
+		{
+			return (i < N ? m_slot[i] : m_spill[i - N]).ptr;
+		}
+		void erase(std::size_t i)
+		{
+			destroy(slot(i));
+			// Keep insertion order, getComponent returns the first match
+			for (; i + 1 < m_size; ++i)
+				slot(i) = slot(i + 1);
+			if (m_size > N) m_spill.pop_back();
+			--m_size;
+		}
+	private:
+		static constexpr std::size_t bufferSize = InlineBytes ? InlineBytes : 1;
 
-			auto it = std::find_if(std::begin(m_component), std::end(m_component), [&](const std::unique_ptr<ComponentBase> &up)
-			{
-				return std::type_index{ typeid(*up.get()) } == ti;
-			});
+		// Size and alignment of a component allocated from the resource, 0 if inline
+		struct Slot
+		{
+			ComponentBaseT *ptr;
+			std::uint32_t size;
+			std::uint32_t align;
+		};
 
-			if (it != std::end(m_component))
+		inline Slot &slot(std::size_t i)
+		{
+			return i < N ? m_slot[i] : m_spill[i - N];
+		}
+		void add(const Slot &s)
+		{
+			if (m_size < N) m_slot[m_size] = s;
+			else m_spill.push_back(s);
+			++m_size;
+		}
+		void *allocateInline(std::size_t size, std::size_t align)
+		{
+			if (align > alignof(std::max_align_t)) return nullptr;
+			auto offset = (m_used + align - 1) & ~(align - 1);
+			if (offset + size > InlineBytes) return nullptr;
+			m_used = offset + size;
+			return m_buffer + offset;
+		}
+		bool isInline(const ComponentBaseT *cp) const
+		{
+			auto p = reinterpret_cast<const unsigned char *>(cp);
+			std::less<const unsigned char *> less;
+			return !less(p, m_buffer) && less(p, m_buffer + bufferSize);
+		}
+		void destroy(Slot &s)
+		{
+			if (isInline(s.ptr))
 			{
-				auto cmapIt = m_compActiveMap.find(it->get());
-				if (cmapIt != std::end(m_compActiveMap))
-					m_compActiveMap.erase(cmapIt);
-				m_component.erase(it);
+				s.ptr->~ComponentBaseT();
+				if (--m_inlineCount == 0) m_used = 0;
+				return;
 			}
+			// Components are polymorphic, so this finds the start of the allocation
+			auto mem = dynamic_cast<void *>(s.ptr);
+			s.ptr->~ComponentBaseT();
+			m_spill.get_allocator().resource()->deallocate(mem, s.size, s.align);
 		}
 
-		void setAllComponentsActive(bool b);
-		void initializeAllComponents();
+		Slot m_slot[N];
+		std::pmr::vector<Slot> m_spill;
+		std::size_t m_size;
+		std::size_t m_used;
+		std::size_t m_inlineCount;
+		alignas(std::max_align_t) unsigned char m_buffer[bufferSize];
+	};
 
-		// Tag management
+	/* Tag policies - Inherited publicly by BasicEntity, so whatever tag interface the
+	policy declares becomes part of the entity.
+
+	VectorTags - Default policy: tags are stored as a vector of strings. They stay on
+	the global heap, so getTags keeps returning std::vector<std::string>.
+	NoTags - No tag interface and no storage.
+	*/
 
+	class VectorTags
+	{
+	public:
 		void addTag(const std::string &tag);
 		bool hasTag(const std::string &tag) const;
 		void removeTag(const std::string &tag);
 		const std::vector<std::string> &getTags();
-
 	protected:
-		std::vector<std::unique_ptr<ComponentBase>> m_component;
 		std::vector<std::string> m_tag;
-		bool m_active;
-		std::map<ComponentBase *, bool> m_compActiveMap;
 	};
 
-	/* EntityNoParent - Variation of Entity for use with ComponentBaseNoParent
+	class NoTags
+	{
+	};
+
+	/* Activity policies - Decide what happens to component activity when an entity is
+	deactivated and reactivated.
+
+	MapActivity - Default policy: remembers each component's prior state and restores it.
+	ResetActivity - Stores nothing; reactivating an entity reactivates all of its components.
 	*/
 
-	class EntityNoParent : public AutoList<EntityNoParent>, public EventHandler
+	template<typename ComponentBaseT>
+	class MapActivity
 	{
 	public:
-		EntityNoParent() :
-			m_active{ true }
+		explicit MapActivity(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			m_compActiveMap{ resource }
+		{}
+		template<typename StorageT>
+		void deactivateComponents(StorageT &storage)
+		{
+			for (std::size_t i = 0; i < storage.size(); ++i)
+			{
+				auto cp = storage.at(i);
+				m_compActiveMap[cp] = cp->active();
+				cp->setActive(false);
+			}
+		}
+		template<typename StorageT>
+		void restoreComponents(StorageT &)
+		{
+			for (auto &pair : m_compActiveMap)
+			{
+				pair.first->setActive(pair.second);
+			}
+		}
+		void forgetComponent(ComponentBaseT *cp)
+		{
+			auto cmapIt = m_compActiveMap.find(cp);
+			if (cmapIt != std::end(m_compActiveMap))
+				m_compActiveMap.erase(cmapIt);
+		}
+	private:
+		std::pmr::map<ComponentBaseT *, bool> m_compActiveMap;
+	};
+
+	class ResetActivity
+	{
+	public:
+		template<typename StorageT>
+		void deactivateComponents(StorageT &storage)
+		{
+			for (std::size_t i = 0; i < storage.size(); ++i)
+				storage.at(i)->setActive(false);
+		}
+		template<typename StorageT>
+		void restoreComponents(StorageT &storage)
+		{
+			for (std::size_t i = 0; i < storage.size(); ++i)
+				storage.at(i)->setActive(true);
+		}
+		template<typename ComponentBaseT>
+		void forgetComponent(ComponentBaseT *)
+		{
+		}
+	};
+
+	/* BasicEntity - Basic Component-holding class. Components should be
+	worked on by systems inheriting from ISystem. Storage, tags and activity
+	handling are compile-time policies, so an application only pays for the
+	features it selects. Entity and EntityNoParent are the default configurations.
+	Policies that take a memory resource are constructed with the entity's, so
+	components, their spill lists and activity maps go away with an arena reset.
+	VectorTags strings, the AutoList instance lists and the EventHandler receiver
+	lists are not resource-backed: the lists are static and shared by every world,
+	so destroy entities normally (or retire them) before releasing their arena.
+	*/
+
+	// Constructs a policy with resource if it accepts one
+	template<typename PolicyT>
+	PolicyT makePolicy(std::pmr::memory_resource *resource)
+	{
+		if constexpr (std::is_constructible<PolicyT, std::pmr::memory_resource *>::value) return PolicyT(resource);
+		else return PolicyT();
+	}
+
+	template<typename ComponentBaseT, typename StoragePolicy, typename TagPolicy, typename ActivityPolicy>
+	class BasicEntity : public AutoList<BasicEntity<ComponentBaseT, StoragePolicy, TagPolicy, ActivityPolicy>>,
+		public EventHandler, public TagPolicy, private ActivityPolicy
+	{
+	public:
+		explicit BasicEntity(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+			TagPolicy(makePolicy<TagPolicy>(resource)), ActivityPolicy(makePolicy<ActivityPolicy>(resource)),
+			m_component(makePolicy<StoragePolicy>(resource)), m_active{ true }, m_pendingFrom{ 0 }
 		{}
-		virtual ~EntityNoParent()
+		virtual ~BasicEntity()
 		{}
-		EntityNoParent(const EntityNoParent &other) = delete;
-		EntityNoParent(EntityNoParent &&other) = delete;
-		EntityNoParent &operator=(const EntityNoParent &other) = delete;
-		EntityNoParent &operator=(EntityNoParent &&other) = delete;
+		BasicEntity(const BasicEntity &other) = delete;
+		BasicEntity(BasicEntity &&other) = delete;
+		BasicEntity &operator=(const BasicEntity &other) = delete;
+		BasicEntity &operator=(BasicEntity &&other) = delete;
 
 		inline void setActive(bool b)
 		{
 			m_active = b;
 			// Set / restore prior active state for components
-			if (m_active)
-			{
-				for (auto &pair : m_compActiveMap)
-				{
-					pair.first->setActive(pair.second);
-				}
-			}
-			else
-			{
-				for (auto &up : m_component)
-				{
-					m_compActiveMap[up.get()] = up->active();
-					up->setActive(false);
-				}
-			}
+			if (m_active) this->restoreComponents(m_component);
+			else this->deactivateComponents(m_component);
 		}
 		inline bool active() const
 		{
@@ -325,19 +693,13 @@ namespace sde
 		template<typename T, typename ...Args>
 		void addComponent(const Args &...args)
 		{
-			m_component.push_back(std::make_unique<T>(args...));
+			m_component.template emplace<T>(args...);
 		}
 		template<typename T>
 		T *getComponent() const
 		{
-			std::type_index ti{ typeid(T) };
-
-			auto it = std::find_if(std::begin(m_component), std::end(m_component), [&](const std::unique_ptr<ComponentBaseNoParent> &up)
-			{
-				return std::type_index{ typeid(*up.get()) } == ti;
-			});
-
-			if (it != std::end(m_component)) return static_cast<T *>(it->get());
+			auto i = findComponent(std::type_index{ typeid(T) });
+			if (i != m_component.size()) return static_cast<T *>(m_component.at(i));
 			return nullptr;
 		}
 		template<typename T>
@@ -346,45 +708,111 @@ namespace sde
 			std::vector<T *> r;
 			std::type_index ti{ typeid(T) };
 
-			for (auto &up : m_component)
+			for (std::size_t i = 0; i < m_component.size(); ++i)
 			{
-				if (std::type_index{ typeid(*up.get()) } == ti) r.push_back(static_cast<T *>(up.get()));
+				auto cp = m_component.at(i);
+				if (std::type_index{ typeid(*cp) } == ti) r.push_back(static_cast<T *>(cp));
 			}
 			return r;
 		}
 		template<typename T>
 		void removeComponent()
 		{
-			std::type_index ti{ typeid(T) };
-
-			auto it = std::find_if(std::begin(m_component), std::end(m_component), [&](const std::unique_ptr<ComponentBaseNoParent> &up)
+			auto i = findComponent(std::type_index{ typeid(T) });
+			if (i != m_component.size())
 			{
-				return std::type_index{ typeid(*up.get()) } == ti;
-			});
-
-			if (it != std::end(m_component))
-			{
-				auto cmapIt = m_compActiveMap.find(it->get());
-				if (cmapIt != std::end(m_compActiveMap))
-					m_compActiveMap.erase(cmapIt);
-				m_component.erase(it);
+				this->forgetComponent(m_component.at(i));
+				if (i < m_pendingFrom)
+					--m_pendingFrom;
+				m_component.erase(i);
 			}
 		}
 
 		void setAllComponentsActive(bool b);
 		void initializeAllComponents();
 
-		// Tag management
+		// Initialize every component added to any entity of this type since the last
+		// pass, batched by concrete type. See initializeByType.
+		static void initializePendingComponents(bool parallel = false);
 
-		void addTag(const std::string &tag);
-		bool hasTag(const std::string &tag) const;
-		void removeTag(const std::string &tag);
-		const std::vector<std::string> &getTags();
+		// Room for n live entities of this type in the AutoList registry
+		static void reserveEntities(std::size_t n)
+		{
+			AutoList<BasicEntity>::reserve(n);
+		}
+
+		// Concurrent reading, see AutoList. retire also takes the entity's and its
+		// components' handlers out of the receiver lists at once; publish republishes
+		// the receivers before the entity list, so retired handlers are only reachable
+		// through snapshots that are retired before them.
+		static void retire(BasicEntity *p)
+		{
+			p->unregisterReceivers();
+			if constexpr (std::is_base_of<EventHandler, ComponentBaseT>::value)
+			{
+				for (std::size_t i = 0; i < p->m_component.size(); ++i)
+					p->m_component.at(i)->unregisterReceivers();
+			}
+			AutoList<BasicEntity>::retire(p);
+		}
+		static void publish(EpochDomain &domain = defaultEpochDomain())
+		{
+			EventHandler::publishReceivers(domain);
+			AutoList<BasicEntity>::publish(domain);
+		}
 
 	protected:
-		std::vector<std::unique_ptr<ComponentBaseNoParent>> m_component;
-		std::vector<std::string> m_tag;
+		StoragePolicy m_component;
 		bool m_active;
-		std::map<ComponentBaseNoParent *, bool> m_compActiveMap;
+		// Components at or past this index have not been initialized yet
+		std::size_t m_pendingFrom;
+
+	private:
+		std::size_t findComponent(std::type_index ti) const
+		{
+			for (std::size_t i = 0; i < m_component.size(); ++i)
+			{
+				if (std::type_index{ typeid(*m_component.at(i)) } == ti) return i;
+			}
+			return m_component.size();
+		}
 	};
+
+	template<typename ComponentBaseT, typename StoragePolicy, typename TagPolicy, typename ActivityPolicy>
+	void BasicEntity<ComponentBaseT, StoragePolicy, TagPolicy, ActivityPolicy>::setAllComponentsActive(bool b)
+	{
+		for (std::size_t i = 0; i < m_component.size(); ++i)
+			m_component.at(i)->setActive(b);
+	}
+
+	template<typename ComponentBaseT, typename StoragePolicy, typename TagPolicy, typename ActivityPolicy>
+	void BasicEntity<ComponentBaseT, StoragePolicy, TagPolicy, ActivityPolicy>::initializeAllComponents()
+	{
+		m_pendingFrom = m_component.size();
+		for (std::size_t i = 0; i < m_component.size(); ++i)
+			m_component.at(i)->initialize();
+	}
+
+	template<typename ComponentBaseT, typename StoragePolicy, typename TagPolicy, typename ActivityPolicy>
+	void BasicEntity<ComponentBaseT, StoragePolicy, TagPolicy, ActivityPolicy>::initializePendingComponents(bool parallel)
+	{
+		using List = AutoList<BasicEntity>;
+		std::vector<ComponentBaseT *> pending;
+		for (std::size_t i = 0; i < List::size(); ++i)
+		{
+			auto ep = List::get(static_cast<int>(i));
+			for (auto j = ep->m_pendingFrom; j < ep->m_component.size(); ++j)
+				pending.push_back(ep->m_component.at(j));
+			ep->m_pendingFrom = ep->m_component.size();
+		}
+		initializeByType(pending, parallel);
+	}
+
+	/* EntityNoParent - Variation of Entity for use with ComponentBaseNoParent
+	*/
+
+	using EntityNoParent = BasicEntity<ComponentBaseNoParent>;
+
+	extern template class BasicEntity<ComponentBase>;
+	extern template class BasicEntity<ComponentBaseNoParent>;
 }